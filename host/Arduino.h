@@ -0,0 +1,113 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Stand-in for the Arduino ESP32 core and FreeRTOS used by the host build.
+
+#pragma once
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define IRAM_ATTR
+
+#define PRO_CPU_NUM (0)
+#define APP_CPU_NUM (1)
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+void *ps_malloc(size_t size);
+void *heap_caps_malloc(size_t size, uint32_t caps);
+
+int64_t esp_timer_get_time(void);
+unsigned long micros(void);
+unsigned long millis(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void disableCore0WDT(void);
+void disableCore1WDT(void);
+
+class HardwareSerial {
+   public:
+    void begin(unsigned long baud) {}
+    size_t write(const char *str) { return fputs(str, stderr); }
+    size_t print(const char *str) { return fputs(str, stderr); }
+    size_t println(const char *str = "") { return fprintf(stderr, "%s\n", str); }
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+   public:
+    void restart(void);
+    uint32_t getFreeHeap(void) { return 0; }
+    uint32_t getFreePsram(void) { return 0; }
+};
+
+extern EspClass ESP;
+
+// FreeRTOS
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE (0)
+#define pdTRUE (1)
+#define pdPASS (1)
+#define pdFAIL (0)
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS (1)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+typedef struct host_task_t *TaskHandle_t;
+typedef struct host_queue_t *QueueHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t task, const char *name, uint32_t stackDepth, void *param, UBaseType_t priority,
+                                TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticks);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+void vQueueDelete(QueueHandle_t queue);
+
+typedef struct host_semaphore_t *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
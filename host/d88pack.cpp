@@ -0,0 +1,168 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Packer of the compressed disk images: a frame of each track of each image of a d88 file.
+//
+//   d88pack IN.d88 OUT.d88.lz4   compress
+//   d88pack -d IN.d88.lz4 OUT.d88  decompress
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "d88.h"
+#include "lz4.h"
+
+#define MAX_FRAME_SIZE (0x10000)
+
+static bool readFile(const char *fileName, std::vector<uint8_t> &data) {
+    auto fp = fopen(fileName, "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    data.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    auto ok = fread(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return ok;
+}
+
+// The offsets where a frame starts: the header and each track of each image
+static std::vector<uint32_t> frameOffsets(const std::vector<uint8_t> &image) {
+    std::vector<uint32_t> offsets;
+    uint32_t base = 0;
+    while (base + sizeof(d88_header_t) <= image.size()) {
+        d88_header_t header;
+        memcpy(&header, image.data() + base, sizeof(header));
+        if (header.diskSize < sizeof(d88_header_t) || base + header.diskSize > image.size()) break;
+
+        offsets.push_back(base);
+        for (int i = 0; i < 164; i++) {
+            if (header.track[i] >= sizeof(d88_header_t) && header.track[i] < header.diskSize) {
+                offsets.push_back(base + header.track[i]);
+            }
+        }
+        base += header.diskSize;
+    }
+    offsets.push_back(base);
+    offsets.push_back(image.size());
+
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    if (offsets.front() != 0) offsets.insert(offsets.begin(), 0);
+
+    // the last offset is the end of the image
+    std::vector<uint32_t> split;
+    for (size_t i = 0; i + 1 < offsets.size(); i++) {
+        for (auto offset = offsets[i]; offset < offsets[i + 1]; offset += MAX_FRAME_SIZE) split.push_back(offset);
+    }
+    split.push_back(image.size());
+    return split;
+}
+
+static int pack(const char *inFileName, const char *outFileName) {
+    std::vector<uint8_t> image;
+    if (!readFile(inFileName, image)) {
+        fprintf(stderr, "can not read %s\n", inFileName);
+        return 1;
+    }
+
+    auto offsets = frameOffsets(image);
+    std::vector<lz4_frame_t> frames(offsets.size() - 1);
+    std::vector<std::vector<uint8_t>> data(frames.size());
+
+    uint32_t fileOffset = sizeof(lz4_container_t) + sizeof(lz4_frame_t) * frames.size();
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto src = image.data() + offsets[i];
+        int size = offsets[i + 1] - offsets[i];
+
+        data[i].resize(LZ4::compressBound(size));
+        auto compressedSize = LZ4::compress(src, size, data[i].data(), data[i].size());
+        if (compressedSize < 0 || compressedSize >= size) {
+            // stored as is
+            data[i].assign(src, src + size);
+            compressedSize = size;
+        }
+        data[i].resize(compressedSize);
+
+        frames[i].offset = offsets[i];
+        frames[i].size = size;
+        frames[i].fileOffset = fileOffset;
+        frames[i].compressedSize = compressedSize;
+        fileOffset += compressedSize;
+    }
+
+    lz4_container_t container;
+    memset(&container, 0, sizeof(container));
+    memcpy(container.id, LZ4_CONTAINER_ID, sizeof(container.id));
+    container.size = image.size();
+    container.frames = frames.size();
+
+    auto fp = fopen(outFileName, "wb");
+    if (!fp) {
+        fprintf(stderr, "can not write %s\n", outFileName);
+        return 1;
+    }
+    auto ok = fwrite(&container, sizeof(container), 1, fp) == 1 && fwrite(frames.data(), sizeof(lz4_frame_t), frames.size(), fp) == frames.size();
+    for (auto &frame : data) {
+        ok = ok && fwrite(frame.data(), 1, frame.size(), fp) == frame.size();
+    }
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "can not write %s\n", outFileName);
+        return 1;
+    }
+
+    printf("%s: %zu bytes, %zu frames, %u bytes (%.1f%%)\n", outFileName, image.size(), frames.size(), fileOffset,
+           image.size() ? fileOffset * 100.0 / image.size() : 0.0);
+    return 0;
+}
+
+static int unpack(const char *inFileName, const char *outFileName) {
+    auto device = Lz4BlockDevice::isContainer(inFileName) ? BlockDevice::open(inFileName, true) : nullptr;
+    if (device == nullptr) {
+        fprintf(stderr, "%s is not a compressed image\n", inFileName);
+        return 1;
+    }
+
+    std::vector<uint8_t> image(device->size());
+    auto ok = device->read(0, image.data(), image.size()) == (long)image.size();
+    delete device;
+
+    auto fp = fopen(outFileName, "wb");
+    ok = ok && fp && fwrite(image.data(), 1, image.size(), fp) == image.size();
+    if (fp) ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "can not unpack %s\n", inFileName);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3) return pack(argv[1], argv[2]);
+    if (argc == 4 && !strcmp(argv[1], "-d")) return unpack(argv[2], argv[3]);
+
+    fprintf(stderr, "usage: %s IN.d88 OUT.d88.lz4\n       %s -d IN.d88.lz4 OUT.d88\n", argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,244 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Stand-in for the parts of FabGL used by the emulator core in the host build.
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "Arduino.h"
+#include "fabutils.h"
+
+#define VGA_640x480_60Hz "\"640x480@60Hz\" 25.175 640 656 752 800 480 490 492 525 -HSync -VSync"
+
+namespace fabgl {
+
+struct RGB222 {
+    uint8_t R : 2;
+    uint8_t G : 2;
+    uint8_t B : 2;
+
+    RGB222(uint8_t red, uint8_t green, uint8_t blue) : R(red), G(green), B(blue) {}
+};
+
+struct RGB888 {
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+
+    RGB888(uint8_t red, uint8_t green, uint8_t blue) : R(red), G(green), B(blue) {}
+};
+
+// Display
+
+typedef void (*DrawScanlineCallback)(void *arg, uint8_t *dest, int scanLine);
+
+class BitmappedDisplayController {
+   public:
+    static int queueSize;
+};
+
+// Raw pixel: bit 0-1 red, bit 2-3 green, bit 4-5 blue, bit 6 HSync, bit 7 VSync
+#define VGA_HVSYNC_INACTIVE (0xc0)
+
+class VGADirectController : public BitmappedDisplayController {
+   public:
+    VGADirectController(bool autoRun = true);
+    ~VGADirectController();
+
+    void begin(void) {}
+    void setResolution(const char *modeline, int viewPortWidth = -1, int viewPortHeight = -1, bool doubleBuffered = false) {}
+    void setScanlinesPerCallBack(int value) { mScanlinesPerCallback = value; }
+    void setDrawScanlineCallback(DrawScanlineCallback callback, void *arg = nullptr) {
+        mDrawScanlineCallback = callback;
+        mDrawScanlineArg = arg;
+    }
+
+    void run(void);
+    void end(void);
+    bool VSync(void) { return mVSync; }
+
+    uint8_t createRawPixel(RGB222 rgb) { return rgb.R | (rgb.G << 2) | (rgb.B << 4) | VGA_HVSYNC_INACTIVE; }
+    uint8_t createBlankRawPixel(void) { return VGA_HVSYNC_INACTIVE; }
+
+    int getScreenWidth(void) { return 640; }
+    int getScreenHeight(void) { return 480; }
+
+   private:
+    int mScanlinesPerCallback;
+    DrawScanlineCallback mDrawScanlineCallback;
+    void *mDrawScanlineArg;
+    std::thread *mThread;
+    std::atomic<bool> mRunning;
+    volatile bool mVSync;
+
+    void frameLoop(void);
+};
+
+// Sound
+
+class WaveformGenerator {
+   public:
+    WaveformGenerator() : next(nullptr), mSampleRate(16000), mVolume(100), mEnabled(false), mDuration(-1) {}
+    virtual ~WaveformGenerator() {}
+
+    virtual void setFrequency(int value) = 0;
+    virtual int getSample(void) = 0;
+
+    void setDuration(uint32_t value) { mDuration = value; }
+    uint32_t duration(void) { return mDuration; }
+    void setVolume(int value) { mVolume = value; }
+    int volume(void) { return mVolume; }
+    bool enabled(void) { return mEnabled; }
+    void enable(bool value) { mEnabled = value; }
+    void setSampleRate(int value) { mSampleRate = value; }
+    uint16_t sampleRate(void) { return mSampleRate; }
+
+    WaveformGenerator *next;
+
+   protected:
+    void decDuration(void) {
+        if (mDuration > 0 && --mDuration == 0) mEnabled = false;
+    }
+
+   private:
+    uint16_t mSampleRate;
+    int mVolume;
+    bool mEnabled;
+    uint32_t mDuration;
+};
+
+class SquareWaveformGenerator : public WaveformGenerator {
+   public:
+    SquareWaveformGenerator() : mFrequency(0) {}
+
+    void setFrequency(int value) { mFrequency = value; }
+    void setDutyCycle(int dutyCycle) {}
+    int getSample(void) { return 0; }
+
+   private:
+    int mFrequency;
+};
+
+class SoundGenerator {
+   public:
+    SoundGenerator(int sampleRate = 16000) : mSampleRate(sampleRate), mVolume(100), mPlaying(false), mChannels(nullptr) {}
+
+    bool play(bool value) {
+        auto playing = mPlaying;
+        mPlaying = value;
+        return playing;
+    }
+    bool playing(void) { return mPlaying; }
+
+    void attach(WaveformGenerator *value) {
+        value->setSampleRate(mSampleRate);
+        value->next = mChannels;
+        mChannels = value;
+    }
+    void detach(WaveformGenerator *value);
+
+    void setVolume(int value) { mVolume = value; }
+    int volume(void) { return mVolume; }
+
+   private:
+    int mSampleRate;
+    int mVolume;
+    bool mPlaying;
+    WaveformGenerator *mChannels;
+};
+
+// Keyboard
+
+enum class PS2Preset {
+    KeyboardPort0_MousePort1,
+    KeyboardPort1_MousePort0,
+    KeyboardPort0,
+    KeyboardPort1,
+    MousePort0,
+    MousePort1,
+};
+
+struct KeyboardLayout {
+    const char *name;
+};
+
+extern const KeyboardLayout JapaneseLayout;
+
+class Keyboard {
+   public:
+    bool begin(bool generateVirtualKeys, bool createVKQueue, int PS2Port) { return true; }
+    void setLayout(const KeyboardLayout *layout) {}
+    bool setLEDs(bool numLock, bool capsLock, bool scrollLock) { return true; }
+    void enableVirtualKeys(bool generateVirtualKeys, bool createVKQueue) {}
+    bool reset(void) { return true; }
+
+    int scancodeAvailable(void);
+    int getNextScancode(int timeOutMS = -1, bool requestResendOnTimeOut = false);
+
+    // Host only: feed raw PS/2 set 2 codes
+    void injectScancode(int scanCode);
+};
+
+class PS2Controller {
+   public:
+    static void begin(PS2Preset preset) {}
+    static Keyboard *keyboard(void);
+};
+
+// Dialogs and files
+
+enum class InputResult {
+    None,
+    Cancel,
+    Enter,
+};
+
+class InputBox {
+   public:
+    void begin(const char *modeline = nullptr, int viewPortWidth = -1, int viewPortHeight = -1, int displayColors = 16) {}
+    void end(void) {}
+    void setBackgroundColor(RGB888 value) {}
+    InputResult message(const char *titleText, const char *messageText, const char *buttonCancelText = nullptr,
+                        const char *buttonOKText = "OK");
+};
+
+class FileBrowser {
+   public:
+    FileBrowser(const char *path);
+    ~FileBrowser();
+
+    static bool mountSDCard(bool formatOnFail, const char *mountPath, size_t maxFiles = 4, int allocationUnitSize = 16 * 1024,
+                            int MISO = 16, int MOSI = 17, int CLK = 14, int CS = 13);
+
+    bool exists(const char *name, bool caseSensitive = true);
+    void makeDirectory(const char *dirname);
+
+   private:
+    char *mDir;
+};
+
+}  // namespace fabgl
+
+using namespace fabgl;
@@ -0,0 +1,316 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Host implementations of the Arduino, FreeRTOS and FabGL stand-ins.
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fabgl.h"
+
+// Arduino
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+void *ps_malloc(size_t size) { return malloc(size); }
+
+void *heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros(void) { return (unsigned long)esp_timer_get_time(); }
+
+unsigned long millis(void) { return micros() / 1000; }
+
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+void delayMicroseconds(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+void disableCore0WDT(void) {}
+void disableCore1WDT(void) {}
+
+size_t HardwareSerial::printf(const char *fmt, ...) {
+    va_list arg_ptr;
+    va_start(arg_ptr, fmt);
+    auto ret = vfprintf(stderr, fmt, arg_ptr);
+    va_end(arg_ptr);
+    return ret;
+}
+
+void EspClass::restart(void) { exit(0); }
+
+// FreeRTOS
+
+struct host_task_t {
+    std::thread *thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint32_t notification = 0;
+};
+
+// The task of the calling thread, the threads not created by xTaskCreateUniversal get one on demand
+static thread_local host_task_t *currentTask = nullptr;
+
+static void startTask(host_task_t *t, TaskFunction_t task, void *param) {
+    currentTask = t;
+    task(param);
+}
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t task, const char *name, uint32_t stackDepth, void *param, UBaseType_t priority,
+                                TaskHandle_t *handle, BaseType_t core) {
+    auto t = new host_task_t;
+    t->thread = new std::thread(startTask, t, task, param);
+    t->thread->detach();
+    if (handle) *handle = t;
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks * portTICK_PERIOD_MS); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (currentTask == nullptr) {
+        currentTask = new host_task_t;
+        currentTask->thread = nullptr;
+    }
+    return currentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notification++;
+    task->cond.notify_all();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticks) {
+    auto task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [task] { return task->notification != 0; };
+    if (ticks == portMAX_DELAY) {
+        task->cond.wait(lock, ready);
+    } else if (!task->cond.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready)) {
+        return 0;
+    }
+    auto value = task->notification;
+    task->notification = clearCountOnExit ? 0 : value - 1;
+    return value;
+}
+
+struct host_queue_t {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    auto queue = new host_queue_t;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto ready = [queue] { return queue->items.size() < queue->length; };
+    if (ticks == portMAX_DELAY) {
+        queue->cond.wait(lock, ready);
+    } else if (!queue->cond.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready)) {
+        return pdFAIL;
+    }
+    auto p = (const uint8_t *)item;
+    queue->items.emplace_back(p, p + queue->itemSize);
+    queue->cond.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto ready = [queue] { return !queue->items.empty(); };
+    if (ticks == portMAX_DELAY) {
+        queue->cond.wait(lock, ready);
+    } else if (!queue->cond.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), ready)) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    queue->cond.notify_all();
+    return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+struct host_semaphore_t {
+    std::timed_mutex mutex;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return new host_semaphore_t; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        semaphore->mutex.lock();
+        return pdTRUE;
+    }
+    return semaphore->mutex.try_lock_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    semaphore->mutex.unlock();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+
+namespace fabgl {
+
+// Display: the callback is driven from a thread at 60 frames per second into a scratch buffer.
+
+int BitmappedDisplayController::queueSize = 1024;
+
+VGADirectController::VGADirectController(bool autoRun)
+    : mScanlinesPerCallback(1), mDrawScanlineCallback(nullptr), mDrawScanlineArg(nullptr), mThread(nullptr), mRunning(false), mVSync(false) {}
+
+VGADirectController::~VGADirectController() { end(); }
+
+void VGADirectController::run(void) {
+    if (mThread) return;
+    mRunning = true;
+    mThread = new std::thread(&VGADirectController::frameLoop, this);
+}
+
+void VGADirectController::end(void) {
+    if (!mThread) return;
+    mRunning = false;
+    mThread->join();
+    delete mThread;
+    mThread = nullptr;
+}
+
+void VGADirectController::frameLoop(void) {
+    std::vector<uint8_t> lines(640 * mScanlinesPerCallback);
+    auto next = std::chrono::steady_clock::now();
+
+    while (mRunning) {
+        mVSync = false;
+        for (int scanLine = 0; scanLine < 480 && mDrawScanlineCallback; scanLine += mScanlinesPerCallback) {
+            mDrawScanlineCallback(mDrawScanlineArg, lines.data(), scanLine);
+        }
+        mVSync = true;
+        next += std::chrono::microseconds(16683);
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// Sound
+
+void SoundGenerator::detach(WaveformGenerator *value) {
+    for (auto p = &mChannels; *p; p = &(*p)->next) {
+        if (*p == value) {
+            *p = value->next;
+            value->next = nullptr;
+            break;
+        }
+    }
+}
+
+// Keyboard
+
+const KeyboardLayout JapaneseLayout = {"Japanese"};
+
+static std::mutex scanCodeMutex;
+static std::deque<int> scanCodes;
+
+int Keyboard::scancodeAvailable(void) {
+    {
+        std::lock_guard<std::mutex> lock(scanCodeMutex);
+        if (!scanCodes.empty()) return scanCodes.size();
+    }
+    delay(1);
+    return 0;
+}
+
+int Keyboard::getNextScancode(int timeOutMS, bool requestResendOnTimeOut) {
+    std::lock_guard<std::mutex> lock(scanCodeMutex);
+    if (scanCodes.empty()) return -1;
+    auto scanCode = scanCodes.front();
+    scanCodes.pop_front();
+    return scanCode;
+}
+
+void Keyboard::injectScancode(int scanCode) {
+    std::lock_guard<std::mutex> lock(scanCodeMutex);
+    scanCodes.push_back(scanCode);
+}
+
+Keyboard *PS2Controller::keyboard(void) {
+    static Keyboard keyboard;
+    return &keyboard;
+}
+
+// Dialogs and files
+
+InputResult InputBox::message(const char *titleText, const char *messageText, const char *buttonCancelText, const char *buttonOKText) {
+    fprintf(stderr, "%s: %s\n", titleText, messageText);
+    return InputResult::Enter;
+}
+
+FileBrowser::FileBrowser(const char *path) { mDir = strdup(path); }
+
+FileBrowser::~FileBrowser() { free(mDir); }
+
+bool FileBrowser::mountSDCard(bool formatOnFail, const char *mountPath, size_t maxFiles, int allocationUnitSize, int MISO, int MOSI,
+                              int CLK, int CS) {
+    struct stat fileStat;
+    if (stat(mountPath, &fileStat) == -1) {
+        return mkdir(mountPath, 0755) == 0;
+    }
+    return S_ISDIR(fileStat.st_mode);
+}
+
+bool FileBrowser::exists(const char *name, bool caseSensitive) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", mDir, name);
+    struct stat fileStat;
+    return stat(path, &fileStat) == 0;
+}
+
+void FileBrowser::makeDirectory(const char *dirname) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", mDir, dirname);
+    mkdir(path, 0755);
+}
+
+}  // namespace fabgl
@@ -0,0 +1,123 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Host entry point: the same sequence as setup() and loop() in PC8801FabGL.ino.
+//
+//   pc8801 [--dump-frame N FILE] [--headless [--cycles N] [--frames N] [--keys FILE] [--load FILE] [--save FILE]]
+//
+//   --dump-frame N FILE  write the screen after N emulated frames to FILE (PPM) and exit
+//   --headless           run without wall clock pacing until the budget is used, then report the results
+//   --cycles N           budget in T-states of the main CPU
+//   --frames N           budget in emulated frames
+//   --keys FILE          key event script, "<frame> down|up <key name>" per line
+//   --load FILE          start from a snapshot
+//   --save FILE          write a snapshot when the budget is used
+
+#include <cstdlib>
+#include <cstring>
+
+#include "pc88vm.h"
+
+PC88VM *vm;
+
+// loop() of PC8801FabGL.ino in a task of its own, PC80S31::run() does not return
+static void loopTask(void *) {
+    while (true) {
+        vm->subTask();
+        delay(1);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [--dump-frame N FILE] [--headless [--cycles N] [--frames N] [--keys FILE] [--load FILE] [--save FILE]]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t dumpFrame = 0;
+    const char *dumpFileName = nullptr;
+    bool headless = false;
+    uint64_t cycles = 0;
+    uint32_t frames = 0;
+    const char *keysFileName = nullptr;
+    const char *loadFileName = nullptr;
+    const char *saveFileName = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--dump-frame") && i + 2 < argc) {
+            dumpFrame = strtoul(argv[i + 1], nullptr, 0);
+            dumpFileName = argv[i + 2];
+            i += 2;
+        } else if (!strcmp(argv[i], "--headless")) {
+            headless = true;
+        } else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) {
+            cycles = strtoull(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "--keys") && i + 1 < argc) {
+            keysFileName = argv[++i];
+        } else if (!strcmp(argv[i], "--load") && i + 1 < argc) {
+            loadFileName = argv[++i];
+        } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+            saveFileName = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (headless && !cycles && !frames) {
+        fprintf(stderr, "--headless needs --cycles or --frames\n");
+        return 1;
+    }
+
+    vm = new PC88VM;
+    if (dumpFrame) vm->setFrameDump(dumpFrame, dumpFileName);
+
+    if (headless) {
+        auto ret = vm->runHeadless(cycles, frames, keysFileName, loadFileName, saveFileName);
+        if (ret < 0) {
+            fprintf(stderr, "headless run error %d\n", ret);
+            return 1;
+        }
+        if (dumpFrame && (!vm->mFrameDumped || vm->mFrameDumpResult < 0)) {
+            fprintf(stderr, "frame dump error %d: %s\n", vm->mFrameDumpResult, dumpFileName);
+            return 1;
+        }
+        return 0;
+    }
+
+    vm->run();
+    xTaskCreateUniversal(&loopTask, "loopTask", 4096, nullptr, 1, nullptr, APP_CPU_NUM);
+
+    while (true) {
+        if (dumpFrame && vm->mFrameDumped) {
+            if (vm->mFrameDumpResult < 0) {
+                fprintf(stderr, "frame dump error %d: %s\n", vm->mFrameDumpResult, dumpFileName);
+                return 1;
+            }
+            return 0;
+        }
+        delay(1);
+    }
+
+    return 0;
+}
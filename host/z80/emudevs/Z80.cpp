@@ -0,0 +1,84 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "Z80.h"
+
+#include <cstring>
+
+namespace fabgl {
+
+void Z80::reset(void) {
+    memset(&state, 0, sizeof(state));
+    state.registers.word[Z80_AF] = 0xffff;
+    state.registers.word[Z80_SP] = 0xffff;
+}
+
+int Z80::step(void) {
+    if (state.status == Z80_STATUS_HALT) return 4;
+
+    switch (m_readByte(m_context, state.pc)) {
+        case 0x76:  // HALT
+            state.status = Z80_STATUS_HALT;
+            break;
+        case 0xf3:  // DI
+            state.iff1 = state.iff2 = 0;
+            state.pc = (state.pc + 1) & 0xffff;
+            break;
+        case 0xfb:  // EI
+            state.iff1 = state.iff2 = 1;
+            state.pc = (state.pc + 1) & 0xffff;
+            break;
+        default:
+            state.pc = (state.pc + 1) & 0xffff;
+            break;
+    }
+    state.r = (state.r & 0x80) | ((state.r + 1) & 0x7f);
+
+    return 4;
+}
+
+int Z80::IRQ(int data_on_bus) {
+    if (!state.iff1) return 0;
+
+    state.status = 0;
+    state.iff1 = state.iff2 = 0;
+    state.registers.word[Z80_SP] -= 2;
+    m_writeWord(m_context, state.registers.word[Z80_SP], state.pc);
+    if (state.im == 2) {
+        state.pc = m_readWord(m_context, ((state.i << 8) | (data_on_bus & 0xff)) & 0xffff);
+        return 19;
+    }
+    state.pc = 0x38;
+    return 13;
+}
+
+int Z80::NMI(void) {
+    state.status = 0;
+    state.iff2 = state.iff1;
+    state.iff1 = 0;
+    state.registers.word[Z80_SP] -= 2;
+    m_writeWord(m_context, state.registers.word[Z80_SP], state.pc);
+    state.pc = 0x66;
+    return 11;
+}
+
+}  // namespace fabgl
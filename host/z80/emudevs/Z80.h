@@ -0,0 +1,128 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+// Stand-in for fabgl::Z80 in the host build when FabGL sources are not available.
+// It fetches one opcode per step through the memory callbacks and does not decode it.
+// Configure with -DPC88_FABGL_DIR=<FabGL> to build against the real CPU core.
+
+#pragma once
+
+#include <cstdint>
+
+namespace fabgl {
+
+enum {
+    Z80_STATUS_HALT = 1,
+    Z80_STATUS_DI,
+    Z80_STATUS_EI,
+    Z80_STATUS_RETI,
+    Z80_STATUS_RETN,
+    Z80_STATUS_ED_UNDEFINED,
+    Z80_STATUS_PREFIX,
+};
+
+enum {
+    Z80_B,
+    Z80_C,
+    Z80_D,
+    Z80_E,
+    Z80_H,
+    Z80_L,
+    Z80_A,
+    Z80_F,
+    Z80_IXH,
+    Z80_IXL,
+    Z80_IYH,
+    Z80_IYL,
+};
+
+enum {
+    Z80_BC,
+    Z80_DE,
+    Z80_HL,
+    Z80_AF,
+    Z80_IX,
+    Z80_IY,
+    Z80_SP,
+};
+
+struct Z80_STATE {
+    int status;
+    union {
+        unsigned char byte[14];
+        unsigned short word[7];
+    } registers;
+    unsigned short alternates[4];
+    int i, r, pc, iff1, iff2, im;
+};
+
+class Z80 {
+   public:
+    typedef int (*ReadByteCallback)(void *context, int addr);
+    typedef void (*WriteByteCallback)(void *context, int addr, int value);
+    typedef int (*ReadWordCallback)(void *context, int addr);
+    typedef void (*WriteWordCallback)(void *context, int addr, int value);
+    typedef int (*ReadIOCallback)(void *context, int addr);
+    typedef void (*WriteIOCallback)(void *context, int addr, int value);
+
+    void setCallbacks(void *context, ReadByteCallback readByte, WriteByteCallback writeByte, ReadWordCallback readWord,
+                      WriteWordCallback writeWord, ReadIOCallback readIO, WriteIOCallback writeIO) {
+        m_context = context;
+        m_readByte = readByte;
+        m_writeByte = writeByte;
+        m_readWord = readWord;
+        m_writeWord = writeWord;
+        m_readIO = readIO;
+        m_writeIO = writeIO;
+    }
+
+    void reset(void);
+    int step(void);
+    int IRQ(int data_on_bus);
+    int NMI(void);
+
+    int getIM(void) { return state.im; }
+    int getIFF1(void) { return state.iff1; }
+    int getIFF2(void) { return state.iff2; }
+    int getStatus(void) { return state.status; }
+
+    int readRegByte(int reg) { return state.registers.byte[reg]; }
+    void writeRegByte(int reg, int value) { state.registers.byte[reg] = value; }
+    int readRegWord(int reg) { return state.registers.word[reg]; }
+    void writeRegWord(int reg, int value) { state.registers.word[reg] = value; }
+
+    uint16_t getPC(void) { return state.pc; }
+    void setPC(uint16_t value) { state.pc = value; }
+
+   private:
+    Z80_STATE state;
+
+    void *m_context;
+    ReadByteCallback m_readByte;
+    WriteByteCallback m_writeByte;
+    ReadWordCallback m_readWord;
+    WriteWordCallback m_writeWord;
+    ReadIOCallback m_readIO;
+    WriteIOCallback m_writeIO;
+};
+
+}  // namespace fabgl
@@ -0,0 +1,316 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "block-device.h"
+
+#include <unistd.h>
+
+#include <cstring>
+
+#ifdef PC88_HOST
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef DEBUG_PC88
+// #define DEBUG_BLOCK_DEVICE
+#endif
+
+BlockDevice *BlockDevice::open(const char *fileName, bool readOnly, int type, long offset, long size) {
+    if (Lz4BlockDevice::isContainer(fileName)) {
+        auto device = new Lz4BlockDevice;
+        if (device->init(fileName, offset, size, type != BLOCK_DEVICE_STDIO) == 0) return device;
+        delete device;
+        return nullptr;
+    }
+
+#ifdef PC88_HOST
+    if (type == BLOCK_DEVICE_MMAP) {
+        auto device = new MmapBlockDevice;
+        if (device->init(fileName, readOnly, offset, size) == 0) return device;
+        delete device;
+    }
+#endif
+    if (type == BLOCK_DEVICE_PSRAM) {
+        auto device = new PsramBlockDevice;
+        if (device->init(fileName, readOnly, offset, size) == 0) return device;
+        delete device;
+    }
+
+#ifdef DEBUG_BLOCK_DEVICE
+    if (type != BLOCK_DEVICE_STDIO) Serial.printf("BlockDevice: type %d is not available, %s is read on demand\n", type, fileName);
+#endif
+
+    auto device = new StdioBlockDevice;
+    if (device->init(fileName, readOnly, offset, size) == 0) return device;
+    delete device;
+    return nullptr;
+}
+
+bool BlockDevice::setWindow(long fileSize, long offset, long size) {
+    if (size < 0) size = fileSize - offset;
+    if (offset < 0 || size < 0 || offset + size > fileSize) return false;
+    mOffset = offset;
+    mSize = size;
+    return true;
+}
+
+// stdio
+
+StdioBlockDevice::~StdioBlockDevice() {
+    if (mFP) fclose(mFP);
+}
+
+int StdioBlockDevice::init(const char *fileName, bool readOnly, long offset, long size) {
+    mReadOnly = readOnly;
+    mFP = fopen(fileName, readOnly ? "rb" : "rb+");
+    if (!mFP) return -1;
+
+    fseek(mFP, 0, SEEK_END);
+    if (!setWindow(ftell(mFP), offset, size)) return -1;
+
+    return 0;
+}
+
+long StdioBlockDevice::read(long offset, void *dest, long size) {
+    if (offset < 0 || offset + size > mSize) return -1;
+    fseek(mFP, mOffset + offset, SEEK_SET);
+    return fread(dest, 1, size, mFP);
+}
+
+long StdioBlockDevice::write(long offset, const void *src, long size) {
+    if (mReadOnly || offset < 0 || offset + size > mSize) return -1;
+    fseek(mFP, mOffset + offset, SEEK_SET);
+    return fwrite(src, 1, size, mFP);
+}
+
+int StdioBlockDevice::sync(void) {
+    if (mReadOnly) return 0;
+    return fflush(mFP) == 0 && fsync(fileno(mFP)) == 0 ? 0 : -1;
+}
+
+// PSRAM: the window is read at once, a write goes to the file through StdioBlockDevice
+
+PsramBlockDevice::~PsramBlockDevice() {
+    if (mData) free(mData);
+}
+
+int PsramBlockDevice::init(const char *fileName, bool readOnly, long offset, long size) {
+    if (StdioBlockDevice::init(fileName, readOnly, offset, size) < 0) return -1;
+
+    mData = (uint8_t *)ps_malloc(mSize > 0 ? mSize : 1);
+    if (mData == nullptr) {
+#ifdef DEBUG_BLOCK_DEVICE
+        Serial.printf("PsramBlockDevice: ps_malloc error %ld\n", mSize);
+#endif
+        return -1;
+    }
+    if (StdioBlockDevice::read(0, mData, mSize) != mSize) return -1;
+
+    return 0;
+}
+
+long PsramBlockDevice::read(long offset, void *dest, long size) {
+    if (offset < 0 || offset + size > mSize) return -1;
+    memcpy(dest, mData + offset, size);
+    return size;
+}
+
+// LZ4 container
+
+Lz4BlockDevice::Lz4BlockDevice() {
+    mReadOnly = true;
+    mFP = nullptr;
+    mFrames = nullptr;
+    mFrameCount = 0;
+    mCompressed = nullptr;
+    mCache = nullptr;
+    mCacheFrame = -1;
+}
+
+Lz4BlockDevice::~Lz4BlockDevice() {
+    if (mFP) fclose(mFP);
+    if (mFrames) free(mFrames);
+    if (mCompressed) free(mCompressed);
+    if (mCache) free(mCache);
+    if (mData) free(mData);
+}
+
+bool Lz4BlockDevice::isContainer(const char *fileName) {
+    auto fp = fopen(fileName, "rb");
+    if (!fp) return false;
+
+    char id[8];
+    auto result = fread(id, 1, sizeof(id), fp) == sizeof(id) && !memcmp(id, LZ4_CONTAINER_ID, sizeof(id));
+    fclose(fp);
+    return result;
+}
+
+int Lz4BlockDevice::init(const char *fileName, long offset, long size, bool preload) {
+    mFP = fopen(fileName, "rb");
+    if (!mFP) return -1;
+
+    lz4_container_t container;
+    if (fread(&container, 1, sizeof(container), mFP) != sizeof(container) || container.frames == 0) return -1;
+
+    mFrameCount = container.frames;
+    mFrames = (lz4_frame_t *)ps_malloc(sizeof(lz4_frame_t) * mFrameCount);
+    if (mFrames == nullptr) return -1;
+    if (fread(mFrames, sizeof(lz4_frame_t), mFrameCount, mFP) != (size_t)mFrameCount) return -1;
+
+    // the frames must cover the image in order
+    uint32_t next = 0;
+    uint32_t maxSize = 0;
+    uint32_t maxCompressedSize = 0;
+    for (int i = 0; i < mFrameCount; i++) {
+        if (mFrames[i].offset != next || mFrames[i].size == 0) return -1;
+        next += mFrames[i].size;
+        if (mFrames[i].size > maxSize) maxSize = mFrames[i].size;
+        if (mFrames[i].compressedSize > maxCompressedSize) maxCompressedSize = mFrames[i].compressedSize;
+    }
+    if (next != container.size || !setWindow(container.size, offset, size)) return -1;
+
+    mCompressed = (uint8_t *)ps_malloc(maxCompressedSize);
+    mCache = (uint8_t *)ps_malloc(maxSize);
+    if (mCompressed == nullptr || mCache == nullptr) return -1;
+
+    // a preloaded image is decompressed at once, it is read on demand when PSRAM is short
+    if (preload && mSize > 0) {
+        auto data = (uint8_t *)ps_malloc(mSize);
+        if (data != nullptr) {
+            if (read(0, data, mSize) == mSize) {
+                mData = data;
+            } else {
+                free(data);
+            }
+        }
+    }
+
+#ifdef DEBUG_BLOCK_DEVICE
+    Serial.printf("Lz4BlockDevice: %s frames %d size %ld preloaded %d\n", fileName, mFrameCount, mSize, mData != nullptr);
+#endif
+    return 0;
+}
+
+// The frame containing the offset of the decompressed image
+int Lz4BlockDevice::findFrame(long offset) {
+    int low = 0;
+    int high = mFrameCount - 1;
+    while (low < high) {
+        auto mid = (low + high + 1) / 2;
+        if (mFrames[mid].offset <= offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+int Lz4BlockDevice::readFrame(int frame, uint8_t *dest) {
+    auto f = &mFrames[frame];
+    fseek(mFP, f->fileOffset, SEEK_SET);
+    if (f->compressedSize == f->size) {
+        return fread(dest, 1, f->size, mFP) == f->size ? 0 : -1;
+    }
+    if (fread(mCompressed, 1, f->compressedSize, mFP) != f->compressedSize) return -1;
+    return LZ4::decompress(mCompressed, f->compressedSize, dest, f->size) == (int)f->size ? 0 : -1;
+}
+
+long Lz4BlockDevice::read(long offset, void *dest, long size) {
+    if (offset < 0 || offset + size > mSize) return -1;
+    if (mData) {
+        memcpy(dest, mData + offset, size);
+        return size;
+    }
+
+    auto out = (uint8_t *)dest;
+    long pos = mOffset + offset;
+    long end = pos + size;
+    for (int i = findFrame(pos); i < mFrameCount && pos < end; i++) {
+        auto f = &mFrames[i];
+        long start = pos - f->offset;
+        long length = (end < (long)(f->offset + f->size) ? end : f->offset + f->size) - pos;
+        if (start == 0 && length == f->size) {
+            if (readFrame(i, out) < 0) return -1;
+        } else {
+            if (mCacheFrame != i) {
+                mCacheFrame = -1;
+                if (readFrame(i, mCache) < 0) return -1;
+                mCacheFrame = i;
+            }
+            memcpy(out, mCache + start, length);
+        }
+        pos += length;
+        out += length;
+    }
+    return pos == end ? size : -1;
+}
+
+#ifdef PC88_HOST
+
+// mmap: a private mapping, so the track buffers change the file only through write()
+
+MmapBlockDevice::~MmapBlockDevice() {
+    if (mMap) munmap(mMap, mMapSize);
+    if (mFD >= 0) close(mFD);
+}
+
+int MmapBlockDevice::init(const char *fileName, bool readOnly, long offset, long size) {
+    mReadOnly = readOnly;
+    mFD = ::open(fileName, readOnly ? O_RDONLY : O_RDWR);
+    if (mFD < 0) return -1;
+
+    struct stat fileStat;
+    if (fstat(mFD, &fileStat) < 0 || !setWindow(fileStat.st_size, offset, size) || mSize == 0) return -1;
+
+    // the mapping starts at a page boundary
+    long pageOffset = mOffset % sysconf(_SC_PAGESIZE);
+    mMapSize = mSize + pageOffset;
+    mMap = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, mFD, mOffset - pageOffset);
+    if (mMap == MAP_FAILED) {
+        mMap = nullptr;
+        return -1;
+    }
+    mData = (uint8_t *)mMap + pageOffset;
+
+    return 0;
+}
+
+long MmapBlockDevice::read(long offset, void *dest, long size) {
+    if (offset < 0 || offset + size > mSize) return -1;
+    memcpy(dest, mData + offset, size);
+    return size;
+}
+
+long MmapBlockDevice::write(long offset, const void *src, long size) {
+    if (mReadOnly || offset < 0 || offset + size > mSize) return -1;
+    return pwrite(mFD, src, size, mOffset + offset);
+}
+
+int MmapBlockDevice::sync(void) {
+    if (mReadOnly) return 0;
+    return fsync(mFD);
+}
+
+#endif
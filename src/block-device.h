@@ -0,0 +1,152 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#include <cstdint>
+
+#include "lz4.h"
+
+#define BLOCK_DEVICE_STDIO (0)  // file on the SD card, read and written on demand
+#define BLOCK_DEVICE_PSRAM (1)  // file read into PSRAM at once, written through to the file
+#define BLOCK_DEVICE_MMAP (2)   // file mapped into memory, host build only
+
+// The backend of a preloaded image
+#ifdef PC88_HOST
+#define BLOCK_DEVICE_PRELOAD BLOCK_DEVICE_MMAP
+#else
+#define BLOCK_DEVICE_PRELOAD BLOCK_DEVICE_PSRAM
+#endif
+
+// A window of a file, offsets are relative to the start of the window.
+// read() and write() return the transferred bytes or a negative value.
+class BlockDevice {
+   public:
+    BlockDevice() {
+        mOffset = 0;
+        mSize = 0;
+        mReadOnly = false;
+        mData = nullptr;
+    }
+    virtual ~BlockDevice() {}
+
+    virtual long read(long offset, void *dest, long size) = 0;
+    virtual long write(long offset, const void *src, long size) = 0;
+    virtual int sync(void) = 0;
+
+    long size(void) { return mSize; }
+    bool isReadOnly(void) { return mReadOnly; }
+
+    // The whole window in memory for zero-copy access, nullptr when it is read on demand.
+    // write() only writes the file, a caller which writes other data than this memory updates it itself.
+    uint8_t *data(void) { return mData; }
+
+    // size < 0: up to the end of the file. Falls back to BLOCK_DEVICE_STDIO when the type is not available.
+    // A compressed container is opened read-only as the decompressed image, preloaded unless the type is BLOCK_DEVICE_STDIO.
+    static BlockDevice *open(const char *fileName, bool readOnly, int type = BLOCK_DEVICE_STDIO, long offset = 0, long size = -1);
+
+   protected:
+    long mOffset;
+    long mSize;
+    bool mReadOnly;
+    uint8_t *mData;
+
+    bool setWindow(long fileSize, long offset, long size);
+};
+
+class StdioBlockDevice : public BlockDevice {
+   public:
+    StdioBlockDevice() { mFP = nullptr; }
+    ~StdioBlockDevice();
+
+    int init(const char *fileName, bool readOnly, long offset, long size);
+
+    long read(long offset, void *dest, long size);
+    long write(long offset, const void *src, long size);
+    int sync(void);
+
+   protected:
+    FILE *mFP;
+};
+
+class PsramBlockDevice : public StdioBlockDevice {
+   public:
+    ~PsramBlockDevice();
+
+    int init(const char *fileName, bool readOnly, long offset, long size);
+
+    long read(long offset, void *dest, long size);
+};
+
+// LZ4 container: a read decompresses the frames it covers, straight into the destination for a whole frame
+class Lz4BlockDevice : public BlockDevice {
+   public:
+    Lz4BlockDevice();
+    ~Lz4BlockDevice();
+
+    static bool isContainer(const char *fileName);
+
+    int init(const char *fileName, long offset, long size, bool preload);
+
+    long read(long offset, void *dest, long size);
+    long write(long, const void *, long) { return -1; }
+    int sync(void) { return 0; }
+
+   private:
+    FILE *mFP;
+    lz4_frame_t *mFrames;
+    int mFrameCount;
+    uint8_t *mCompressed;  // a compressed frame
+    uint8_t *mCache;       // the last frame read in part
+    int mCacheFrame;
+
+    int findFrame(long offset);
+    int readFrame(int frame, uint8_t *dest);
+};
+
+#ifdef PC88_HOST
+class MmapBlockDevice : public BlockDevice {
+   public:
+    MmapBlockDevice() {
+        mFD = -1;
+        mMap = nullptr;
+        mMapSize = 0;
+    }
+    ~MmapBlockDevice();
+
+    int init(const char *fileName, bool readOnly, long offset, long size);
+
+    long read(long offset, void *dest, long size);
+    long write(long offset, const void *src, long size);
+    int sync(void);
+
+   private:
+    int mFD;
+    void *mMap;
+    size_t mMapSize;
+};
+#endif
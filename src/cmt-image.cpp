@@ -0,0 +1,140 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "cmt-image.h"
+
+#include <cstdlib>
+
+#ifdef DEBUG_PC88
+// #define DEBUG_CMT_IMAGE
+#endif
+
+// Addresses of the pointers in the work area of N-BASIC and N88-BASIC
+static const cmt_basic_work_t basicWork[2] = {{0xeb54, 0xefa0, 0xefa2, 0xefa4}, {0xe658, 0xeb18, 0xeb1a, 0xeb1c}};
+
+int CmtImage::load(const char *fileName, uint8_t *ram, bool n88, uint16_t *start) {
+    auto fp = fopen(fileName, "rb");
+    if (!fp) return CMT_IMAGE_ERROR;
+
+    fseek(fp, 0, SEEK_END);
+    auto size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    auto tape = (uint8_t *)ps_malloc(size > 0 ? size : 1);
+    if (tape == nullptr || size < 0 || (long)fread(tape, 1, size, fp) != size) {
+        if (tape) free(tape);
+        fclose(fp);
+        return CMT_IMAGE_ERROR;
+    }
+    fclose(fp);
+
+    // skip the leader to the first block
+    long offset = 0;
+    while (offset < size && tape[offset] != CMT_BASIC_ID && tape[offset] != CMT_MACHINE_ID) offset++;
+
+    int ret = CMT_IMAGE_FORMAT_ERROR;
+    if (offset < size && tape[offset] == CMT_BASIC_ID) {
+        ret = loadBasic(tape + offset, size - offset, ram, n88);
+    } else if (offset < size) {
+        ret = loadMachine(tape + offset, size - offset, ram, start);
+    }
+    free(tape);
+
+#ifdef DEBUG_CMT_IMAGE
+    Serial.printf("CmtImage: %s %d\n", fileName, ret);
+#endif
+    return ret;
+}
+
+// The lines are linked by absolute addresses, they are linked again from the start of the text of this BASIC
+int CmtImage::loadBasic(const uint8_t *tape, long size, uint8_t *ram, bool n88) {
+    auto work = &basicWork[n88 ? 1 : 0];
+
+    long offset = 0;
+    while (offset < CMT_BASIC_ID_LENGTH) {
+        if (offset >= size || tape[offset] != CMT_BASIC_ID) return CMT_IMAGE_FORMAT_ERROR;
+        offset++;
+    }
+    offset += CMT_BASIC_NAME_LENGTH;
+
+    // the text ends before the work area
+    uint32_t address = getWord(ram, work->txttab);
+    if (address == 0 || address >= work->txttab) return CMT_IMAGE_NO_BASIC;
+
+    while (true) {
+        if (offset + 2 > size) return CMT_IMAGE_FORMAT_ERROR;
+        if (tape[offset] == 0 && tape[offset + 1] == 0) break;
+
+        // link, line number and the text up to 00h
+        auto end = offset + 4;
+        while (end < size && tape[end] != 0) end++;
+        if (end >= size) return CMT_IMAGE_FORMAT_ERROR;
+        end++;
+
+        auto length = end - offset;
+        if (address + length + 2 > work->txttab) return CMT_IMAGE_FORMAT_ERROR;
+        memcpy(ram + address, tape + offset, length);
+        setWord(ram, address, address + length);
+        address += length;
+        offset = end;
+    }
+    setWord(ram, address, 0);
+    address += 2;
+
+    // as NEW after the text is loaded
+    setWord(ram, work->vartab, address);
+    setWord(ram, work->arytab, address);
+    setWord(ram, work->strend, address);
+    return CMT_IMAGE_BASIC;
+}
+
+int CmtImage::loadMachine(const uint8_t *tape, long size, uint8_t *ram, uint16_t *start) {
+    if (size < 4 || tape[0] != CMT_MACHINE_ID) return CMT_IMAGE_FORMAT_ERROR;
+    if (((tape[1] + tape[2] + tape[3]) & 0xff) != 0) return CMT_IMAGE_CHECKSUM_ERROR;
+
+    uint16_t address = (tape[1] << 8) | tape[2];
+    *start = address;
+
+    long offset = 4;
+    while (true) {
+        if (offset + 2 > size || tape[offset] != CMT_MACHINE_ID) return CMT_IMAGE_FORMAT_ERROR;
+        int length = tape[offset + 1];
+        if (length == 0) break;
+        if (offset + 2 + length + 1 > size) return CMT_IMAGE_FORMAT_ERROR;
+
+        auto data = tape + offset + 2;
+        uint8_t sum = length;
+        for (int i = 0; i <= length; i++) sum += data[i];
+        if (sum != 0) return CMT_IMAGE_CHECKSUM_ERROR;
+
+        for (int i = 0; i < length; i++) {
+            ram[address] = data[i];
+            address++;
+        }
+        offset += 2 + length + 1;
+    }
+
+#ifdef DEBUG_CMT_IMAGE
+    Serial.printf("CmtImage: machine code %04x - %04x\n", *start, address - 1);
+#endif
+    return CMT_IMAGE_MACHINE;
+}
@@ -0,0 +1,71 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#include <cstdint>
+
+#define CMT_IMAGE_BASIC (1)
+#define CMT_IMAGE_MACHINE (2)
+
+#define CMT_IMAGE_ERROR (-1)
+#define CMT_IMAGE_FORMAT_ERROR (-2)
+#define CMT_IMAGE_CHECKSUM_ERROR (-3)
+#define CMT_IMAGE_NO_BASIC (-4)
+
+// BASIC program on a tape: 10 x D3h, a name of 6 bytes and the text
+#define CMT_BASIC_ID (0xd3)
+#define CMT_BASIC_ID_LENGTH (10)
+#define CMT_BASIC_NAME_LENGTH (6)
+
+// Machine code on a tape: 3Ah, address (big endian), checksum, then 3Ah, length, data, checksum until the length is 0
+#define CMT_MACHINE_ID (0x3a)
+
+// Pointers of the BASIC work area: start of the text, start of the variables and arrays, end of the arrays
+typedef struct {
+    uint16_t txttab;
+    uint16_t vartab;
+    uint16_t arytab;
+    uint16_t strend;
+} cmt_basic_work_t;
+
+// Put the first program of a cmt file into the 64 KB main RAM as CLOAD or the monitor would
+class CmtImage {
+   public:
+    // Returns CMT_IMAGE_BASIC or CMT_IMAGE_MACHINE, start is the first address of the machine code
+    static int load(const char *fileName, uint8_t *ram, bool n88, uint16_t *start);
+
+   private:
+    static int loadBasic(const uint8_t *tape, long size, uint8_t *ram, bool n88);
+    static int loadMachine(const uint8_t *tape, long size, uint8_t *ram, uint16_t *start);
+
+    static uint16_t getWord(const uint8_t *ram, int address) { return ram[address] | (ram[(address + 1) & 0xffff] << 8); }
+    static void setWord(uint8_t *ram, int address, uint16_t value) {
+        ram[address] = value & 0xff;
+        ram[(address + 1) & 0xffff] = value >> 8;
+    }
+};
@@ -23,7 +23,9 @@
 #include "d88.h"
 
 #include <Arduino.h>
-#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
 
 #ifdef DEBUG_PC88
 // #define DEBUG_D88
@@ -33,100 +35,127 @@
 #define DISK_TYPE_D88 (0x01)
 #define DISK_TYPE_2W (0x02)
 
-#define DISK_2D (0x00)
-#define DISK_2DD (0x10)
-#define DISK_2HD (0x20)
-
 PC88D88::PC88D88() {
     mType = DISK_TYPE_UNKNOWN;
-    mFP = nullptr;
+    mDevice = nullptr;
     mHeader = nullptr;
     mTrack = nullptr;
+    mImage = nullptr;
     mWriteProtect = false;
 
+    mBase = 0;
     mDiskSize = 0;
     mMaxTrack = 0;
+
+    mLock = xSemaphoreCreateMutex();
+    mFlushLock = xSemaphoreCreateMutex();
+    mDirty = false;
+    mLastWrite = 0;
+    mJournalName[0] = '\0';
 }
 
 PC88D88::~PC88D88() {}
 
-int PC88D88::open(const char* fileName) {
-    if (mFP != nullptr) {
-        close();
+int PC88D88::open(const char* fileName, int image, bool preload) {
+    xSemaphoreTake(mFlushLock, portMAX_DELAY);
+    auto ret = openImage(fileName, image, preload);
+    xSemaphoreGive(mFlushLock);
+    return ret;
+}
+
+int PC88D88::close(void) {
+    xSemaphoreTake(mFlushLock, portMAX_DELAY);
+    auto ret = flushTracks();
+    closeImage();
+    xSemaphoreGive(mFlushLock);
+    return ret;
+}
+
+int PC88D88::openImage(const char* fileName, int image, bool preload) {
+    if (mDevice != nullptr) {
+        flushTracks();
+        closeImage();
     }
 
     const char* ext = strrchr(fileName, '.');
 
     if (ext == nullptr) return -1;
 
-    if (!strcasecmp(ext, ".D88")) {
-        struct stat fileStat;
-        if (stat(fileName, &fileStat) == -1) {
-            return -1;
-        }
-
+    // a d88 file, or a d88 file in an LZ4 container that is read-only
+    if (!strcasecmp(ext, ".D88") || !strcasecmp(ext, LZ4_CONTAINER_EXT)) {
         mHeader = (d88_header_t*)ps_malloc(sizeof(d88_header_t));
 
-        mFP = fopen(fileName, "rb+");
-        if (!mFP) {
+        // the whole file for the journal and the headers
+        mDevice = BlockDevice::open(fileName, false);
+        if (mHeader == nullptr || mDevice == nullptr) {
 #ifdef DEBUG_D88
             Serial.printf("Open error: %s\n", fileName);
 #endif
+            closeImage();
             return -1;
         }
 
-        mDiskSize = fileStat.st_size;
-
-        fseek(mFP, 0, SEEK_SET);
-        size_t result = fread(mHeader, 1, sizeof(d88_header_t), mFP);
+        if (image > 0) {
+            snprintf(mJournalName, sizeof(mJournalName), "%s.%d%s", fileName, image, D88_JOURNAL_EXT);
+        } else {
+            snprintf(mJournalName, sizeof(mJournalName), "%s%s", fileName, D88_JOURNAL_EXT);
+        }
+        replayJournal();
 
-        if (result != sizeof(d88_header_t)) {
-            close();
+        if (readHeader(image) < 0) {
+            closeImage();
             return -1;
         }
 
 #ifdef DEBUG_D88
         Serial.println(mHeader->name);
 #endif
-        if (mDiskSize != mHeader->diskSize) {
+
+        switch (mHeader->diskType) {
+            case DISK_2D:
+                mMaxTrack = 84;
+                break;
+            case DISK_2DD:
+            case DISK_2HD:
+                mMaxTrack = 164;
+                break;
+            default:
 #ifdef DEBUG_D88
-            Serial.printf("disk size error %d %d", mDiskSize, mHeader->diskSize);
+                Serial.printf("disk type error %02x\n", mHeader->diskType);
 #endif
-            close();
-            return -1;
+                closeImage();
+                return -1;
         }
 
-        if (mHeader->diskType != DISK_2D) return -1;
-        mMaxTrack = 84;
+        mWriteProtect = mHeader->writeProtect != 0x00 || mDevice->isReadOnly();
 
-        mWriteProtect = mHeader->writeProtect != 0x00;
-
-        if (mWriteProtect) {
-            fclose(mFP);
-            mFP = fopen(fileName, "rb");
-            if (!mFP) {
+        // The image itself: read-only when it is write-protected, resident in memory when it is preloaded
+        delete mDevice;
+        mDevice = BlockDevice::open(fileName, mWriteProtect, preload ? BLOCK_DEVICE_PRELOAD : BLOCK_DEVICE_STDIO, mBase, mDiskSize);
+        if (mDevice == nullptr) {
 #ifdef DEBUG_D88
-                Serial.printf("Open error: %s\n", fileName);
-#endif
-                return -1;
-            }
-#ifdef DEBUG_D88
-            Serial.printf("Reopened %s as read-only because it is write-protected.\n", fileName);
+            Serial.printf("Open error: %s\n", fileName);
 #endif
+            closeImage();
+            return -1;
         }
+        mImage = mDevice->data();
 
         mTrack = (d88_track_t*)ps_malloc(sizeof(d88_track_t) * mMaxTrack);
         if (mTrack == nullptr) {
-            close();
+            closeImage();
             return -1;
         }
 
 #ifdef DEBUG_D88
-        Serial.printf("maxTrack: %d diskSize: %04x\n", mMaxTrack, mHeader->diskSize);
+        Serial.printf("image: %d maxTrack: %d diskSize: %04x\n", image, mMaxTrack, mHeader->diskSize);
 #endif
 
         for (int i = 0; i < mMaxTrack; i++) {
             mTrack[i].buff = nullptr;
+            mTrack[i].index = nullptr;
+            mTrack[i].dirtyStart = 0;
+            mTrack[i].dirtyEnd = 0;
             if (mHeader->track[i] > 0) {
                 mTrack[i].offset = mHeader->track[i];
                 auto nextOffset = mHeader->diskSize;
@@ -142,6 +171,16 @@ int PC88D88::open(const char* fileName) {
 #endif
             } else {
                 mTrack[i].offset = 0;
+                mTrack[i].size = 0;
+            }
+        }
+
+        // a preloaded image needs no track buffers of its own
+        if (mImage != nullptr) {
+            for (int i = 0; i < mMaxTrack; i++) {
+                if (mTrack[i].offset > 0 && mTrack[i].offset + mTrack[i].size <= mDiskSize) {
+                    mTrack[i].buff = mImage + mTrack[i].offset;
+                }
             }
         }
 
@@ -153,10 +192,44 @@ int PC88D88::open(const char* fileName) {
     }
 }
 
-int PC88D88::close(void) {
-    if (mFP != nullptr) {
-        fclose(mFP);
-        mFP = nullptr;
+// Read the header of the image from the device of the whole file, the images of a multi-volume file follow each other
+int PC88D88::readHeader(int image) {
+    if (image < 0 || image >= D88_MAX_IMAGE) return -1;
+
+    auto fileSize = mDevice->size();
+    mBase = 0;
+    for (int i = 0;; i++) {
+        auto result = mDevice->read(mBase, mHeader, sizeof(d88_header_t));
+        if (result != sizeof(d88_header_t) || mHeader->diskSize < sizeof(d88_header_t) || mBase + mHeader->diskSize > fileSize) {
+#ifdef DEBUG_D88
+            Serial.printf("disk size error %ld %d", fileSize - mBase, mHeader->diskSize);
+#endif
+            return -1;
+        }
+        if (i == image) break;
+        mBase += mHeader->diskSize;
+    }
+    mDiskSize = mHeader->diskSize;
+
+    // The track table ends at the first track, some images have a table shorter than 164 tracks
+    uint32_t tableEnd = sizeof(d88_header_t);
+    for (int i = 0; i < 164; i++) {
+        if (mHeader->track[i] > 0 && mHeader->track[i] < tableEnd) tableEnd = mHeader->track[i];
+    }
+    for (int i = 0; i < 164; i++) {
+        if (offsetof(d88_header_t, track) + (i + 1) * sizeof(uint32_t) > tableEnd || mHeader->track[i] >= mDiskSize) {
+            mHeader->track[i] = 0;
+        }
+    }
+
+    return 0;
+}
+
+void PC88D88::closeImage(void) {
+    mDirty = false;
+    if (mDevice != nullptr) {
+        delete mDevice;
+        mDevice = nullptr;
     }
     if (mHeader != nullptr) {
         free(mHeader);
@@ -164,33 +237,32 @@ int PC88D88::close(void) {
     }
     if (mTrack != nullptr) {
         for (int i = 0; i < mMaxTrack; i++) {
-            if (mTrack[i].buff != nullptr) {
+            if (mTrack[i].buff != nullptr && mImage == nullptr) {
                 free(mTrack[i].buff);
-                mTrack[i].buff = nullptr;
+            }
+            mTrack[i].buff = nullptr;
+            if (mTrack[i].index != nullptr) {
+                free(mTrack[i].index);
+                mTrack[i].index = nullptr;
             }
         }
         free(mTrack);
         mTrack = nullptr;
     }
-    return 0;
+    mImage = nullptr;
 }
 
 int PC88D88::readData(uint8_t* dest, d88_io_parameter_t* ioParam) {
     auto trackNo = ioParam->cylinder * 2 + ioParam->HD;
-    if (getTrackBuffer(trackNo) == nullptr) {
+    auto index = getTrackIndex(trackNo);
+    if (index == nullptr) {
         return -1;
     }
-    auto track = &mTrack[trackNo];
 
-    auto buf = track->buff;
-    auto header = (d88_sector_header_t*)buf;
-    for (int i = 1; i <= header->numberOfSector; i++) {
-        header = (d88_sector_header_t*)buf;
-        if (memcmp(&header->geometry, &ioParam->C, 4) == 0) {
-            memcpy(dest, buf + sizeof(d88_sector_header_t), header->sizeOfData);
-            return header->sizeOfData;
-        }
-        buf += sizeof(d88_sector_header_t) + header->sizeOfData;
+    auto sector = findSector(index, &ioParam->C, ioParam->MF);
+    if (sector != nullptr) {
+        memcpy(dest, sector->data, sector->size);
+        return sector->size;
     }
 #ifdef DEBUG_D88
     Serial.printf("D88: sector not found");
@@ -198,15 +270,51 @@ int PC88D88::readData(uint8_t* dest, d88_io_parameter_t* ioParam) {
     return -1;
 }
 
+int PC88D88::getSector(d88_io_parameter_t* ioParam, d88_sector_view_t* view) {
+    auto trackNo = ioParam->cylinder * 2 + ioParam->HD;
+    auto index = getTrackIndex(trackNo);
+    if (index == nullptr) {
+        return D88_IO_ERROR;
+    }
+
+    auto sector = findSector(index, &ioParam->C, ioParam->MF);
+    if (sector == nullptr) {
+        return D88_SECTOR_NOT_FOUND;
+    }
+
+    view->data = sector->data;
+    view->size = sector->size;
+    view->trackNo = trackNo;
+    return sector->size;
+}
+
+int PC88D88::getSectorForWrite(d88_io_parameter_t* ioParam, d88_sector_view_t* view) {
+    if (!isReady()) {
+        return D88_NO_READY;
+    }
+    if (isWriteProtect()) {
+        return D88_WRITE_PROTECT;
+    }
+    return getSector(ioParam, view);
+}
+
+void PC88D88::commitSector(d88_sector_view_t* view) {
+    if (mTrack == nullptr || view->trackNo >= mMaxTrack) return;
+    auto track = &mTrack[view->trackNo];
+    uint32_t start = view->data - track->buff;
+
+    xSemaphoreTake(mLock, portMAX_DELAY);
+    markDirty(track, start, start + view->size);
+    xSemaphoreGive(mLock);
+}
+
 int PC88D88::readDiagnostic(uint8_t* dest, d88_io_parameter_t* ioParam) {
     auto trackNo = ioParam->cylinder * 2 + ioParam->HD;
-    auto buf = getTrackBuffer(trackNo);
-    if (buf != nullptr) {
+    auto index = getTrackIndex(trackNo);
+    if (index == nullptr) {
         return -1;
     }
 
-    auto offset = 0;
-
     // Preamble
     auto pre = (d88_disk_preamble_t*)dest;
     memset(&pre->gap0[0], 0x4e, 80);
@@ -215,14 +323,14 @@ int PC88D88::readDiagnostic(uint8_t* dest, d88_io_parameter_t* ioParam) {
     memset(&pre->gap0[0], 0x4e, 50);
 
     dest += sizeof(d88_disk_preamble_t);
-    auto header = (d88_sector_header_t*)buf;
-    auto numberOfSector = header->numberOfSector;
-    for (int i = 1; i <= numberOfSector; i++) {
+    for (int i = 0; i < index->count; i++) {
+        auto sector = &index->sector[i];
+
         // ID field
         auto idField = (d88_disk_id_field_t*)dest;
         memset(&idField->sync[0], 0, 12);
         idField->am1 = 0xfea1a1a1;
-        memcpy(&idField->geometry, &header->geometry, sizeof(d88_geometry_t));
+        memcpy(&idField->geometry, &sector->header->geometry, sizeof(d88_geometry_t));
         idField->crc = 0xffff;
         memset(&idField->gap2[0], 0, 22);
         dest += sizeof(d88_disk_id_field_t);
@@ -231,13 +339,10 @@ int PC88D88::readDiagnostic(uint8_t* dest, d88_io_parameter_t* ioParam) {
         auto dataField = (d88_disk_data_field_t*)dest;
         memset(&dataField->sync[0], 0, 12);
         dataField->am2 = 0xfba1a1a1;
-        memcpy(&dataField->data[0], buf + sizeof(d88_sector_header_t), header->sizeOfData);
+        memcpy(&dataField->data[0], sector->data, sector->size < 256 ? sector->size : 256);
         dataField->crc = 0xffff;
         memset(&dataField->gap3[0], 0x4e, 22);
         dest += sizeof(d88_disk_data_field_t);
-
-        buf += sizeof(d88_sector_header_t) + header->sizeOfData;
-        header = (d88_sector_header_t*)buf;
     }
     // Postamble
     auto postamble = (d88_disk_postamble_t*)dest;
@@ -254,29 +359,25 @@ int PC88D88::readDiagnostic(uint8_t* dest, d88_io_parameter_t* ioParam) {
 
 int PC88D88::readID(uint8_t* dest, d88_io_parameter_t* ioParam) {
     auto trackNo = ioParam->cylinder * 2 + ioParam->HD;
-    auto buf = getTrackBuffer(trackNo);
-    if (buf == nullptr) {
+    auto index = getTrackIndex(trackNo);
+    if (index == nullptr || index->count == 0) {
         return -1;
     }
-    auto header = (d88_sector_header_t*)buf;
-    auto numberOfSector = header->numberOfSector;
 
-    if (mNextSector > numberOfSector) {
-        mNextSector = 1;
-    }
+    // the next sector recorded with the density of the command
+    for (int i = 0; i < index->count; i++) {
+        if (mNextSector > index->count) {
+            mNextSector = 1;
+        }
+        auto header = index->sector[mNextSector - 1].header;
+        mNextSector++;
+        if (isMFM(header) == ioParam->MF) {
 #ifdef DEBUG_D88
-    Serial.printf("Read id: %d\n", mNextSector);
+            Serial.printf("Read id: %d\n", mNextSector - 1);
 #endif
-
-    for (int i = 1; i <= numberOfSector; i++) {
-        if (mNextSector == i) {
             memcpy(dest, &header->geometry, sizeof(d88_geometry_t));
-            mNextSector++;
             return 4;
         }
-
-        buf += sizeof(d88_sector_header_t) + header->sizeOfData;
-        header = (d88_sector_header_t*)buf;
     }
     return -1;
 }
@@ -289,7 +390,8 @@ int PC88D88::writeData(uint8_t* src, d88_io_parameter_t* ioParam) {
         return D88_WRITE_PROTECT;
     }
     auto trackNo = ioParam->cylinder * 2 + ioParam->HD;
-    if (getTrackBuffer(trackNo) == nullptr) {
+    auto index = getTrackIndex(trackNo);
+    if (index == nullptr) {
         return D88_IO_ERROR;
     }
     auto track = &mTrack[trackNo];
@@ -298,27 +400,20 @@ int PC88D88::writeData(uint8_t* src, d88_io_parameter_t* ioParam) {
     Serial.printf("PC88D88::writeData: offset %08x\n", track->offset);
 #endif
 
-    auto buff = track->buff;
-    auto header = (d88_sector_header_t*)buff;
-
-    for (int i = 1; i <= header->numberOfSector; i++) {
-        header = (d88_sector_header_t*)buff;
-        if (memcmp(&header->geometry, &ioParam->C, 4) == 0) {
+    auto sector = findSector(index, &ioParam->C, ioParam->MF);
+    if (sector != nullptr) {
 #ifdef DEBUG_D88
-            Serial.printf("write Data: %02x %02x %02x %02x %03x\n", ioParam->C, ioParam->H, ioParam->R, ioParam->N, header->sizeOfData);
+        Serial.printf("write Data: %02x %02x %02x %02x %03x\n", ioParam->C, ioParam->H, ioParam->R, ioParam->N, sector->size);
 #endif
-            memcpy(buff + sizeof(d88_sector_header_t), src, header->sizeOfData);
-            fseek(mFP, track->offset + buff + sizeof(d88_sector_header_t) - track->buff, SEEK_SET);
-            size_t result = fwrite(src, 1, header->sizeOfData, mFP);
-            if (result != header->sizeOfData) {
-                return D88_IO_ERROR;
-            }
+        uint32_t start = sector->data - track->buff;
+        xSemaphoreTake(mLock, portMAX_DELAY);
+        memcpy(sector->data, src, sector->size);
+        markDirty(track, start, start + sector->size);
+        xSemaphoreGive(mLock);
 #ifdef DEBUG_D88
-            Serial.println("write data ok");
+        Serial.println("write data ok");
 #endif
-            return header->sizeOfData;
-        }
-        buff += sizeof(d88_sector_header_t) + header->sizeOfData;
+        return sector->size;
     }
 #ifdef DEBUG_D88
     Serial.printf("D88: sector not found\n");
@@ -342,13 +437,19 @@ int PC88D88::writeID(d88_write_id_t* ioParam) {
     auto buf = track->buff;
 
     auto sectorSize = 128 << ioParam->N;
+    if (ioParam->SC * (sizeof(d88_sector_header_t) + sectorSize) > track->size) {
+        return D88_IO_ERROR;
+    }
+
     d88_sector_header_t sectorHeader;
     memset(&sectorHeader, 0, sizeof(d88_sector_header_t));
     sectorHeader.numberOfSector = ioParam->SC;
+    sectorHeader.density = !ioParam->MF ? D88_DENSITY_FM : mHeader->diskType == DISK_2HD ? D88_DENSITY_HD : D88_DENSITY_MFM;
     sectorHeader.sizeOfData = sectorSize;
 
     int offset = 0;
 
+    xSemaphoreTake(mLock, portMAX_DELAY);
     for (int i = 0; i < ioParam->SC; i++) {
 #ifdef DEBUG_D88
         Serial.printf("%02x %02x %02x %02x\n", ioParam->id[i].C, ioParam->id[i].H, ioParam->id[i].R, ioParam->id[i].N);
@@ -359,32 +460,235 @@ int PC88D88::writeID(d88_write_id_t* ioParam) {
         memset(buf + offset, ioParam->DataPattern, sectorSize);
         offset += sectorSize;
     }
-    fseek(mFP, track->offset, SEEK_SET);
-    size_t result = fwrite(buf, 1, offset, mFP);
-    if (result != offset) {
-        return D88_IO_ERROR;
-    }
+    markDirty(track, 0, offset);
+    xSemaphoreGive(mLock);
+
+    buildIndex(track);
 #ifdef DEBUG_D88
     Serial.printf("%08x %04x\n", track->offset, offset);
 #endif
     return ioParam->SC;
 }
 
+d88_track_index_t* PC88D88::getTrackIndex(int trackNo) {
+    if (getTrackBuffer(trackNo) == nullptr) return nullptr;
+    auto track = &mTrack[trackNo];
+    if (track->index == nullptr) buildIndex(track);
+    return track->index;
+}
+
+// Walk the sectors of a loaded or formatted track once, a sector past the end of the track ends the index
+void PC88D88::buildIndex(d88_track_t* track) {
+    auto numberOfSector = track->size >= sizeof(d88_sector_header_t) ? ((d88_sector_header_t*)track->buff)->numberOfSector : 0;
+
+    if (track->index != nullptr) free(track->index);
+    track->index = (d88_track_index_t*)ps_malloc(sizeof(d88_track_index_t) + sizeof(d88_sector_t) * numberOfSector);
+    if (track->index == nullptr) return;
+
+    auto index = track->index;
+    index->sector = (d88_sector_t*)(index + 1);
+    index->count = 0;
+    for (int i = 0; i < 32; i++) index->first[i] = D88_INDEX_END;
+
+    uint16_t* last[32];
+    for (int i = 0; i < 32; i++) last[i] = &index->first[i];
+
+    uint32_t offset = 0;
+    for (int i = 0; i < numberOfSector; i++) {
+        if (offset + sizeof(d88_sector_header_t) > track->size) break;
+        auto header = (d88_sector_header_t*)(track->buff + offset);
+        if (offset + sizeof(d88_sector_header_t) + header->sizeOfData > track->size) break;
+
+        auto sector = &index->sector[i];
+        memcpy(&sector->chrn, &header->geometry, 4);
+        sector->header = header;
+        sector->data = track->buff + offset + sizeof(d88_sector_header_t);
+        sector->size = header->sizeOfData;
+        sector->next = D88_INDEX_END;
+
+        auto hash = D88_INDEX_HASH(header->geometry.r);
+        *last[hash] = i;
+        last[hash] = &sector->next;
+
+        index->count++;
+        offset += sizeof(d88_sector_header_t) + header->sizeOfData;
+    }
+}
+
+// The first sector in track order with the ID and the density (MF) of the command, as the linear search did
+d88_sector_t* PC88D88::findSector(d88_track_index_t* index, const uint8_t* chrn, bool mf) {
+    uint32_t key;
+    memcpy(&key, chrn, 4);
+    for (auto i = index->first[D88_INDEX_HASH(chrn[2])]; i != D88_INDEX_END; i = index->sector[i].next) {
+        auto sector = &index->sector[i];
+        if (sector->chrn == key && isMFM(sector->header) == mf) return sector;
+    }
+    return nullptr;
+}
+
+// mLock is held
+void PC88D88::markDirty(d88_track_t* track, uint32_t start, uint32_t end) {
+    if (track->dirtyEnd == 0) {
+        track->dirtyStart = start;
+        track->dirtyEnd = end;
+    } else {
+        if (start < track->dirtyStart) track->dirtyStart = start;
+        if (end > track->dirtyEnd) track->dirtyEnd = end;
+    }
+    mLastWrite = millis();
+    mDirty = true;
+}
+
+int PC88D88::flush(uint32_t idleTime) {
+    if (!mDirty || millis() - mLastWrite < idleTime) return 0;
+
+    xSemaphoreTake(mFlushLock, portMAX_DELAY);
+    auto ret = flushTracks();
+    xSemaphoreGive(mFlushLock);
+    return ret;
+}
+
+// mFlushLock is held. The dirty range of a track is copied under mLock, so the sub CPU only waits for the copy
+int PC88D88::flushTracks(void) {
+    if (!mDirty || mTrack == nullptr) return 0;
+
+    uint32_t maxSize = 0;
+    for (int i = 0; i < mMaxTrack; i++) {
+        if (mTrack[i].size > maxSize) maxSize = mTrack[i].size;
+    }
+    auto block = (uint8_t*)ps_malloc(maxSize);
+    if (block == nullptr) return D88_IO_ERROR;
+
+    xSemaphoreTake(mLock, portMAX_DELAY);
+    mDirty = false;
+    xSemaphoreGive(mLock);
+
+    int ret = 0;
+    for (int i = 0; i < mMaxTrack; i++) {
+        auto track = &mTrack[i];
+
+        xSemaphoreTake(mLock, portMAX_DELAY);
+        auto start = track->dirtyStart;
+        auto end = track->dirtyEnd;
+        if (end > 0) {
+            memcpy(block, track->buff + start, end - start);
+            track->dirtyStart = 0;
+            track->dirtyEnd = 0;
+        }
+        xSemaphoreGive(mLock);
+
+        if (end == 0) continue;
+
+        if (commit(track->offset + start, block, end - start) < 0) {
+            // keep it dirty, it is written by the next flush
+            xSemaphoreTake(mLock, portMAX_DELAY);
+            markDirty(track, start, end);
+            xSemaphoreGive(mLock);
+            ret = D88_IO_ERROR;
+        }
+    }
+
+    free(block);
+
+#ifdef DEBUG_D88
+    Serial.printf("flush: %d\n", ret);
+#endif
+    return ret;
+}
+
+// Write a block at offset in the image to the journal, then to the image, then remove the journal.
+// A power loss leaves either the old image with a broken journal, or a complete journal to be replayed.
+int PC88D88::commit(uint32_t offset, uint8_t* data, uint32_t size) {
+    d88_journal_t journal;
+    memset(&journal, 0, sizeof(journal));
+    strcpy(journal.id, D88_JOURNAL_ID);
+    journal.offset = mBase + offset;
+    journal.size = size;
+    journal.checksum = checksum(data, size);
+
+    auto fp = fopen(mJournalName, "wb");
+    if (!fp) return D88_IO_ERROR;
+    bool ok = fwrite(&journal, sizeof(journal), 1, fp) == 1 && fwrite(data, 1, size, fp) == size;
+    ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0 && ok;
+    fclose(fp);
+    if (!ok) return D88_IO_ERROR;
+
+    ok = mDevice->write(offset, data, size) == size;
+    ok = mDevice->sync() == 0 && ok;
+    if (!ok) return D88_IO_ERROR;
+
+    remove(mJournalName);
+    return size;
+}
+
+void PC88D88::replayJournal(void) {
+    auto fp = fopen(mJournalName, "rb");
+    if (!fp) return;
+
+    d88_journal_t journal;
+    uint8_t* data = nullptr;
+    if (fread(&journal, sizeof(journal), 1, fp) == 1 && !strncmp(journal.id, D88_JOURNAL_ID, sizeof(journal.id)) &&
+        journal.offset + journal.size <= mDevice->size()) {
+        data = (uint8_t*)ps_malloc(journal.size);
+    }
+    if (data != nullptr) {
+        if (fread(data, 1, journal.size, fp) == journal.size && checksum(data, journal.size) == journal.checksum) {
+            mDevice->write(journal.offset, data, journal.size);
+            mDevice->sync();
+            if (mDevice->data() != nullptr) {
+                memcpy(mDevice->data() + journal.offset, data, journal.size);
+            }
+#ifdef DEBUG_D88
+            Serial.printf("journal replayed: offset %08x size %04x\n", journal.offset, journal.size);
+#endif
+        }
+        free(data);
+    }
+    fclose(fp);
+
+    // a broken journal was written before the image was touched
+    remove(mJournalName);
+}
+
+uint32_t PC88D88::checksum(const uint8_t* data, uint32_t size) {
+    uint32_t sum = 5381;
+    for (uint32_t i = 0; i < size; i++) {
+        sum = sum * 33 + data[i];
+    }
+    return sum;
+}
+
+// The stdio device shares its FILE with the flush, so a track is read under mFlushLock
 uint8_t* PC88D88::getTrackBuffer(int trackNo) {
+    if (mTrack == nullptr || trackNo < 0 || trackNo >= mMaxTrack) return nullptr;
+    auto buff = mTrack[trackNo].buff;
+    if (buff != nullptr) return buff;
+
+    xSemaphoreTake(mFlushLock, portMAX_DELAY);
+    buff = readTrack(trackNo);
+    xSemaphoreGive(mFlushLock);
+    return buff;
+}
+
+// mFlushLock is held, the image may be closed and the track read by another task meanwhile
+uint8_t* PC88D88::readTrack(int trackNo) {
+    if (mTrack == nullptr || trackNo >= mMaxTrack) return nullptr;
     auto track = &mTrack[trackNo];
+    if (track->offset == 0) return nullptr;
     if (track->buff == nullptr) {
-        track->buff = (uint8_t*)ps_malloc(track->size);
-        if (track->buff == nullptr) {
+        // the buffer is set when it is read, isTrackLoaded() of the FDC sees a whole track
+        auto buff = (uint8_t*)ps_malloc(track->size);
+        if (buff == nullptr) {
 #ifdef DEBUG_D88
             Serial.printf("readData - ps_malloc error %d\n", track->size);
 #endif
             return nullptr;
         }
-        fseek(mFP, track->offset, SEEK_SET);
-        size_t result = fread(track->buff, 1, track->size, mFP);
-        if (result != track->size) {
+        if (mDevice->read(track->offset, buff, track->size) != track->size) {
+            free(buff);
             return nullptr;
         }
+        track->buff = buff;
 #ifdef DEBUG_D88
         Serial.println("readData - read buff");
 #endif
@@ -392,7 +696,15 @@ uint8_t* PC88D88::getTrackBuffer(int trackNo) {
     return track->buff;
 }
 
-bool PC88D88::isReady(void) { return mFP != nullptr; }
+// A missing track is loaded as well, there is nothing to read
+bool PC88D88::isTrackLoaded(int trackNo) {
+    if (mTrack == nullptr || trackNo < 0 || trackNo >= mMaxTrack) return true;
+    return mTrack[trackNo].offset == 0 || mTrack[trackNo].buff != nullptr;
+}
+
+int PC88D88::loadTrack(int trackNo) { return getTrackBuffer(trackNo) != nullptr ? 0 : D88_IO_ERROR; }
+
+bool PC88D88::isReady(void) { return mDevice != nullptr; }
 
 bool PC88D88::isWriteProtect(void) { return mWriteProtect; }
 
@@ -404,3 +716,28 @@ bool PC88D88::exists(const char* fileName) {
     }
     return false;
 }
+
+int PC88D88::getImages(const char* fileName, d88_image_t* images, int maxImages) {
+    auto device = BlockDevice::open(fileName, true);
+    if (device == nullptr) return -1;
+
+    long fileSize = device->size();
+
+    d88_header_t header;
+    long base = 0;
+    int count = 0;
+    while (count < maxImages && base + (long)sizeof(d88_header_t) <= fileSize) {
+        if (device->read(base, &header, sizeof(d88_header_t)) != sizeof(d88_header_t)) break;
+        if (header.diskSize < sizeof(d88_header_t) || base + header.diskSize > fileSize) break;
+
+        memcpy(images[count].name, header.name, sizeof(header.name));
+        images[count].name[sizeof(header.name) - 1] = '\0';
+        images[count].diskType = header.diskType;
+        images[count].writeProtect = header.writeProtect != 0x00;
+        count++;
+        base += header.diskSize;
+    }
+    delete device;
+
+    return count;
+}
@@ -24,16 +24,39 @@
 
 #pragma GCC optimize("O2")
 
+#include <Arduino.h>
 #include <stdio.h>
 
 #include <cstring>
 #include <cstdint>
 
+#include "block-device.h"
+
 #define D88_IO_ERROR (-1)
 #define D88_NO_READY (-2)
 #define D88_WRITE_PROTECT (-3)
 #define D88_SECTOR_NOT_FOUND (-4)
 
+// Write-back: the written sectors stay in the track buffers and are flushed D88_FLUSH_DELAY ms after the last write
+#define D88_FLUSH_DELAY (500)
+#define D88_FLUSH_INTERVAL (250)
+
+#define D88_JOURNAL_ID "D88JNL"
+#define D88_JOURNAL_EXT ".jnl"
+
+// Disk type of d88_header_t
+#define DISK_2D (0x00)
+#define DISK_2DD (0x10)
+#define DISK_2HD (0x20)
+
+// Density of d88_sector_header_t
+#define D88_DENSITY_MFM (0x00)
+#define D88_DENSITY_FM (0x40)
+#define D88_DENSITY_HD (0x01)
+
+// Images in a multi-volume D88 file, one after another with their own header
+#define D88_MAX_IMAGE (16)
+
 typedef struct {
     bool MT;
     bool MF;
@@ -94,12 +117,54 @@ typedef struct {
     uint16_t sizeOfData;
 } d88_sector_header_t;
 
+typedef struct {
+    char name[17];
+    uint8_t diskType;
+    bool writeProtect;
+} d88_image_t;
+
+// Sector index of a track: the sectors in track order, chained by the low bits of R for the lookup by CHRN
+#define D88_INDEX_HASH(r) ((r) & 0x1f)
+#define D88_INDEX_END (0xffff)
+
+typedef struct {
+    uint32_t chrn;  // d88_geometry_t as one word
+    d88_sector_header_t* header;
+    uint8_t* data;
+    uint16_t size;
+    uint16_t next;  // next sector with the same hash, D88_INDEX_END at the end
+} d88_sector_t;
+
+typedef struct {
+    int count;
+    uint16_t first[32];
+    d88_sector_t* sector;  // follows this header in the same allocation
+} d88_track_index_t;
+
 typedef struct {
     int offset;
     uint32_t size;
     uint8_t* buff;
+    d88_track_index_t* index;
+    uint32_t dirtyStart;  // dirty range in the track buffer, written back as one block
+    uint32_t dirtyEnd;
 } d88_track_t;
 
+// Sector data in a track buffer, valid until the track is formatted or the disk is closed
+typedef struct {
+    uint8_t* data;
+    int size;
+    int trackNo;
+} d88_sector_view_t;
+
+// Journal file: the block to be written to the image, it is replayed when the image is opened after a power loss
+typedef struct {
+    char id[8];
+    uint32_t offset;
+    uint32_t size;
+    uint32_t checksum;
+} d88_journal_t;
+
 typedef struct {
     uint8_t gap0[80];
     uint8_t sync[12];
@@ -132,9 +197,15 @@ class PC88D88 {
     PC88D88();
     ~PC88D88();
 
-    int open(const char* fileName);
+    // image: the image of a multi-volume file
+    // preload: keep the whole image in memory (PSRAM, mmap on the host), tracks are read on first access when it is short
+    int open(const char* fileName, int image = 0, bool preload = true);
     int close(void);
 
+    // Write the dirty tracks back to the image, if no sector was written for idleTime ms
+    int flush(uint32_t idleTime = 0);
+    bool isDirty(void) { return mDirty; }
+
     int readData(uint8_t* dest, d88_io_parameter_t* ioParam);
     int readDiagnostic(uint8_t* dest, d88_io_parameter_t* ioParam);
     int readID(uint8_t* dest, d88_io_parameter_t* ioParam);
@@ -142,20 +213,59 @@ class PC88D88 {
     int writeData(uint8_t* src, d88_io_parameter_t* ioParam);
     int writeID(d88_write_id_t* ioParam);
 
+    // Transfer a sector in place: the FDC reads or writes the track buffer through the view,
+    // a sector written through a view is marked dirty by commitSector()
+    int getSector(d88_io_parameter_t* ioParam, d88_sector_view_t* view);
+    int getSectorForWrite(d88_io_parameter_t* ioParam, d88_sector_view_t* view);
+    void commitSector(d88_sector_view_t* view);
+
     bool isReady(void);
     bool isWriteProtect(void);
+    bool isPreloaded(void) { return mImage != nullptr; }
 
     static bool exists(const char* fileName);
 
+    // Images of a D88 file, returns the number of images or -1
+    static int getImages(const char* fileName, d88_image_t* images, int maxImages);
+
     uint8_t* getTrackBuffer(int trackNo);
 
+    // A track in memory is transferred without file I/O, loadTrack() reads it in another task than the FDC
+    bool isTrackLoaded(int trackNo);
+    int loadTrack(int trackNo);
+
    private:
+    int openImage(const char* fileName, int image, bool preload);
+    int readHeader(int image);
+    uint8_t* readTrack(int trackNo);
+    void closeImage(void);
+
+    d88_track_index_t* getTrackIndex(int trackNo);
+    void buildIndex(d88_track_t* track);
+    d88_sector_t* findSector(d88_track_index_t* index, const uint8_t* chrn, bool mf);
+    static bool isMFM(d88_sector_header_t* header) { return (header->density & D88_DENSITY_FM) == 0; }
+
+    void markDirty(d88_track_t* track, uint32_t start, uint32_t end);
+    int flushTracks(void);
+    int commit(uint32_t offset, uint8_t* data, uint32_t size);
+    void replayJournal(void);
+    static uint32_t checksum(const uint8_t* data, uint32_t size);
+
     int mType;
-    FILE* mFP;
+    BlockDevice* mDevice;
     d88_header_t* mHeader;
     d88_track_t* mTrack;
+    uint8_t* mImage;  // whole image when the device is resident in memory, the track buffers point into it
+    long mBase;       // file offset of the image, the offsets of the device are relative to it
     long mDiskSize;
     int mMaxTrack;
     int mNextSector;
     bool mWriteProtect;
+
+    // mLock guards the track buffers and the dirty ranges, mFlushLock serializes flush, open and close
+    SemaphoreHandle_t mLock;
+    SemaphoreHandle_t mFlushLock;
+    volatile bool mDirty;
+    volatile uint32_t mLastWrite;
+    char mJournalName[256];
 };
@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 
 #include "pc88vm.h"
+#include "snapshot.h"
 
 #ifdef DEBUG_PC88
 // #define DEBUG_DR320
@@ -38,17 +39,18 @@
 #define PD8251_STATUS_TXRDY (0x01)
 
 DR320::DR320() {
-    mTape = nullptr;
+    mDecoder = nullptr;
     mMode = true;
     mCmtEnable = false;
     mMTON = false;
     mHighBps = false;
     mCDS = false;
     mInterruptEnable = false;
+    mFastTape = false;
 }
 DR320::~DR320() {}
 
-void DR320::init(QueueHandle_t* xQueue) { mXQueue = xQueue; }
+void DR320::init(std::atomic<uint32_t>* intRequest) { mIntRequest = intRequest; }
 
 void DR320::systemControl(uint8_t value) {
 #ifdef DEBUG_DR320
@@ -61,8 +63,8 @@ void DR320::systemControl(uint8_t value) {
     mCDS = value & 0x04;
 
     if (!mMTON) {
-        if (mTape && mWrite) {
-            fflush(mTape);
+        if (mWrite) {
+            mTape.flush();
         }
     }
 }
@@ -90,19 +92,17 @@ int DR320::open(const char* fileName) {
         return -1;
     }
 
-    mTape = fopen(fileName, "rb+");
-    if (!mTape) {
+    if (mTape.open(fileName) < 0) {
 #ifdef DEBUG_DR320
         Serial.printf("Open error: %s\n", fileName);
 #endif
         return -1;
     }
+    mDecoder = TapeDecoder::create(&mTape);
 #ifdef DEBUG_DR320
     Serial.printf("Open: %s\n", fileName);
 #endif
 
-    fseek(mTape, 0, SEEK_SET);
-
     mStatus = 0;
 
     mInit = false;
@@ -111,25 +111,32 @@ int DR320::open(const char* fileName) {
 }
 
 int DR320::close(void) {
-    if (mTape) {
-        fclose(mTape);
-        mTape = nullptr;
+    if (mDecoder) {
+        delete mDecoder;
+        mDecoder = nullptr;
     }
-    return 0;
+    return mTape.close();
 }
 
 uint8_t DR320::readData(void) {  // Port 20;
     uint8_t buf = 0xff;
 
-    if (mTape) {
-        if (mInit) {
+    if (mTape.isOpen()) {
+        // a cmt file has no leader, its first read returns 0x3a before the data. T88 and WAV files are read from their leader.
+        if (mInit && mDecoder->isRaw()) {
             mInit = false;
-            return 0x3a;
-        }
-        auto s = fread(&buf, 1, 1, mTape);
-        if (s != 1) {
-            mStatus &= ~PD8251_STATUS_RXRDY;
+            buf = 0x3a;
+        } else {
+            mInit = false;
+            auto value = mDecoder->read(mHighBps);
+            if (value < 0) {
+                mStatus &= ~PD8251_STATUS_RXRDY;
+                return buf;
+            }
+            buf = value;
         }
+        // back to the CMT interrupt when the motor is off
+        if (mFastTape) interrupt();
     }
 
 #ifdef DEBUG_DR320
@@ -141,7 +148,7 @@ uint8_t DR320::readData(void) {  // Port 20;
 void DR320::writeData(uint8_t value)  // Port 20
 {
     mWrite = true;
-    fwrite(&value, 1, 1, mTape);
+    if (mTape.isOpen() && mDecoder->isWritable()) mTape.write(value);
 #ifdef DEBUG_DR320
     Serial.printf("%02x ", value);
 #endif
@@ -183,15 +190,13 @@ void DR320::modeCommand(uint8_t value) {  // Port 21
 
 void DR320::interrupt(void) {
     if (mInterruptEnable & mMTON) {
-        cpu_cmd_t msg;
-        msg.cmd = INT_RXRDY;
-        xQueueSend(*mXQueue, &msg, 0);
+        mIntRequest->fetch_or(INT_REQUEST(INT_RXRDY));
     }
 }
 
 void DR320::rewind(void) {
-    if (mTape) {
-        fseek(mTape, 0, SEEK_SET);
+    if (mTape.isOpen()) {
+        mDecoder->rewind();
 #ifdef DEBUG_DR320
         Serial.println("DR320 -- rewind");
 #endif
@@ -199,10 +204,30 @@ void DR320::rewind(void) {
 }
 
 void DR320::eot(void) {
-    if (mTape) {
-        fseek(mTape, 0, SEEK_END);
+    if (mTape.isOpen()) {
+        mDecoder->seekEnd();
 #ifdef DEBUG_DR320
         Serial.println("DR320 -- EOT");
 #endif
     }
-}
\ No newline at end of file
+}
+
+// The tape file itself is not saved, only the position in the mounted tape
+void DR320::snapshot(FILE* fp, bool save) {
+    long offset = mTape.isOpen() ? mDecoder->tell() : -1;
+
+    SNAPSHOT_IO(fp, save, mStatus);
+    SNAPSHOT_IO(fp, save, mMode);
+    SNAPSHOT_IO(fp, save, mMTON);
+    SNAPSHOT_IO(fp, save, mCmtEnable);
+    SNAPSHOT_IO(fp, save, mHighBps);
+    SNAPSHOT_IO(fp, save, mCDS);
+    SNAPSHOT_IO(fp, save, mInterruptEnable);
+    SNAPSHOT_IO(fp, save, mInit);
+    SNAPSHOT_IO(fp, save, mWrite);
+    SNAPSHOT_IO(fp, save, offset);
+
+    if (!save && mTape.isOpen() && offset >= 0) {
+        mDecoder->seek(offset);
+    }
+}
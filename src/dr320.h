@@ -23,17 +23,20 @@
 #pragma once
 
 #pragma GCC optimize("O2")
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
 
 #include "fabgl.h"
+#include "tape-decoder.h"
+#include "tape-stream.h"
 
 class DR320 {
    public:
     DR320();
     ~DR320();
 
-    void init(QueueHandle_t* xQueue);
+    void init(std::atomic<uint32_t>* intRequest);
     int open(const char* fileName);
     int close(void);
     uint8_t readData(void);
@@ -46,9 +49,14 @@ class DR320 {
     void rewind(void);
     void eot(void);
 
+    // The next byte is ready as soon as the CPU reads a byte, instead of at the 300Hz CMT interrupt
+    void setFastTape(bool value) { mFastTape = value; }
+    void snapshot(FILE* fp, bool save);
+
    private:
-    QueueHandle_t* mXQueue;
-    FILE* mTape;
+    std::atomic<uint32_t>* mIntRequest;
+    TapeStream mTape;
+    TapeDecoder* mDecoder;  // cmt, T88 or WAV
     uint8_t mStatus;
     bool mMode;
     bool mMTON;
@@ -58,4 +66,5 @@ class DR320 {
     bool mInterruptEnable;
     bool mInit;
     bool mWrite;
+    bool mFastTape;
 };
\ No newline at end of file
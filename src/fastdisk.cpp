@@ -0,0 +1,281 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "fastdisk.h"
+
+#include <Arduino.h>
+
+#ifdef DEBUG_PC88
+// #define DEBUG_FASTDISK
+#endif
+
+FASTDISK::FASTDISK() {
+    mMain = nullptr;
+    mSub = nullptr;
+    mPD765C = nullptr;
+    mBuffer = nullptr;
+}
+
+FASTDISK::~FASTDISK() {}
+
+int FASTDISK::init(I8255 *main, I8255 *sub, PD765C *fdc) {
+    mMain = main;
+    mSub = sub;
+    mPD765C = fdc;
+
+    mBuffer = (uint8_t *)ps_malloc(FASTDISK_SECTORS * FASTDISK_SECTOR_SIZE);
+    if (mBuffer == nullptr) return -1;
+
+    reset();
+
+    return 0;
+}
+
+void FASTDISK::reset(void) {
+    mSending = false;
+    mCmd = 0xff;
+    mParamCount = 0;
+    mParamOffset = 0;
+    mDataCount = 0;
+    mDataOffset = 0;
+    mReadCount = 0;
+    mStatus = FASTDISK_OK;
+
+    mSub->mPortB = 0xff;
+    mSub->mPortC = HS_RFD;
+}
+
+// The sub side of the handshake:
+//   main to sub: main DAV on -> latch port B, DAC on, RFD off; main DAV off -> DAC off, RFD on
+//   sub to main: main RFD on -> data on port B, DAV on; main DAC on -> DAV off, next byte
+void FASTDISK::update(void *context) {
+    auto fd = (FASTDISK *)context;
+    auto main = fd->mMain->mPortC;
+    auto &sub = fd->mSub->mPortC;
+
+    if ((main & HS_DAV) && !(sub & HS_DAC)) {
+        sub = (sub & ~HS_RFD) | HS_DAC;
+        fd->receive(fd->mMain->mPortB, main & HS_ATN);
+    } else if (!(main & HS_DAV) && (sub & HS_DAC)) {
+        sub &= ~HS_DAC;
+        if (!fd->mSending) sub |= HS_RFD;
+    }
+
+    if (!fd->mSending) return;
+
+    if ((main & HS_RFD) && !(main & HS_DAC) && !(sub & HS_DAV)) {
+        fd->mSub->mPortB = fd->mSendData[fd->mDataOffset];
+        sub |= HS_DAV;
+    } else if ((main & HS_DAC) && (sub & HS_DAV)) {
+        sub &= ~HS_DAV;
+        fd->mDataOffset++;
+        if (fd->mDataOffset >= fd->mDataCount) {
+            fd->mSending = false;
+            if (!(sub & HS_DAC)) sub |= HS_RFD;
+        }
+    }
+}
+
+void FASTDISK::receive(uint8_t value, bool attention) {
+    if (attention) {
+        command(value);
+    } else if (mParamOffset < mParamCount) {
+        mParam[mParamOffset++] = value;
+        if (mParamOffset == mParamCount) execute();
+    } else if (mDataOffset < mDataCount) {
+        mBuffer[mDataOffset++] = value;
+        if (mDataOffset == mDataCount) writeSectors();
+    }
+}
+
+void FASTDISK::command(uint8_t value) {
+    mCmd = value;
+    mSending = false;
+    mSub->mPortC &= ~HS_DAV;
+    mParamOffset = 0;
+    mDataOffset = 0;
+    mDataCount = 0;
+
+    switch (mCmd) {
+        case 0x01:  // Write data: sectors, drive, track, sector, data
+        case 0x02:  // Read data: sectors, drive, track, sector
+            mParamCount = 4;
+            break;
+        case 0x17:  // Change mode: mode
+            mParamCount = 1;
+            break;
+        default:
+            mParamCount = 0;
+            break;
+    }
+
+#ifdef DEBUG_FASTDISK
+    Serial.printf("FASTDISK command: %02x\n", mCmd);
+#endif
+
+    if (mParamCount == 0) execute();
+}
+
+void FASTDISK::execute(void) {
+    switch (mCmd) {
+        case 0x00:  // Initialize
+            mStatus = FASTDISK_OK;
+            mReadCount = 0;
+            break;
+        case 0x01:  // Write data
+            mDataCount = (mParam[0] > FASTDISK_SECTORS ? FASTDISK_SECTORS : mParam[0]) * FASTDISK_SECTOR_SIZE;
+            mDataOffset = 0;
+            if (mDataCount == 0) writeSectors();
+            break;
+        case 0x02:  // Read data
+            readSectors();
+            break;
+        case 0x03:  // Send data
+        case 0x11:  // Send data (High speed), with the normal handshake
+            send(mBuffer, mReadCount * FASTDISK_SECTOR_SIZE);
+            break;
+        case 0x06:  // Send result status
+            mResult = mStatus;
+            mStatus = FASTDISK_OK;
+            send(&mResult, 1);
+            break;
+        case 0x07:  // Send drive status
+        case 0x14:  // Device status
+            mResult = driveStatus();
+            send(&mResult, 1);
+            break;
+        case 0x13:  // Error status
+            mResult = mStatus;
+            send(&mResult, 1);
+            break;
+        case 0x17:  // Change mode
+        case 0x19:  // Read after write mode set
+        case 0x1a:  // Read after write mode reset
+            break;
+        case 0x18:  // Send mode data
+            mResult = 0;
+            send(&mResult, 1);
+            break;
+        default:
+#ifdef DEBUG_FASTDISK
+            Serial.printf("FASTDISK not supported command: %02x\n", mCmd);
+#endif
+            break;
+    }
+}
+
+void FASTDISK::send(uint8_t *data, int count) {
+    if (count == 0) return;
+
+    mSendData = data;
+    mDataCount = count;
+    mDataOffset = 0;
+    mSending = true;
+    mSub->mPortC &= ~HS_RFD;
+}
+
+// Track is cylinder * 2 + head, the sector numbers are 1 to 16
+void FASTDISK::setIO(d88_io_parameter_t *io, int track, int sector) {
+    memset(io, 0, sizeof(d88_io_parameter_t));
+    io->MF = true;
+    io->US = mParam[1] & 0x03;
+    io->HD = track & 0x01;
+    io->cylinder = track >> 1;
+    io->C = io->cylinder;
+    io->H = io->HD;
+    io->R = sector;
+    io->N = 1;
+    io->sectorLength = FASTDISK_SECTOR_SIZE;
+}
+
+void FASTDISK::readSectors(void) {
+    auto disk = mPD765C->getDisk(mParam[1] & 0x03);
+    int track = mParam[2];
+    int sector = mParam[3];
+
+    mReadCount = mParam[0] > FASTDISK_SECTORS ? FASTDISK_SECTORS : mParam[0];
+    mStatus = disk->isReady() ? FASTDISK_OK : FASTDISK_ERROR;
+
+    for (int i = 0; i < mReadCount; i++) {
+        auto dest = mBuffer + i * FASTDISK_SECTOR_SIZE;
+        d88_io_parameter_t io;
+        d88_sector_view_t view;
+        setIO(&io, track, sector);
+        auto rc = disk->isReady() ? disk->getSector(&io, &view) : D88_NO_READY;
+        if (rc > 0) {
+            memcpy(dest, view.data, rc < FASTDISK_SECTOR_SIZE ? rc : FASTDISK_SECTOR_SIZE);
+        } else {
+            memset(dest, 0, FASTDISK_SECTOR_SIZE);
+            mStatus = FASTDISK_ERROR;
+        }
+        if (++sector > FASTDISK_SECTORS) {
+            sector = 1;
+            track++;
+        }
+    }
+
+#ifdef DEBUG_FASTDISK
+    Serial.printf("FASTDISK read: %d sectors, drive %d, track %d, sector %d, status %d\n", mParam[0], mParam[1], mParam[2], mParam[3],
+                  mStatus);
+#endif
+}
+
+void FASTDISK::writeSectors(void) {
+    auto disk = mPD765C->getDisk(mParam[1] & 0x03);
+    int track = mParam[2];
+    int sector = mParam[3];
+    int count = mDataCount / FASTDISK_SECTOR_SIZE;
+
+    mStatus = FASTDISK_OK;
+    for (int i = 0; i < count; i++) {
+        d88_io_parameter_t io;
+        d88_sector_view_t view;
+        setIO(&io, track, sector);
+        auto rc = disk->getSectorForWrite(&io, &view);
+        if (rc > 0) {
+            memcpy(view.data, mBuffer + i * FASTDISK_SECTOR_SIZE, rc < FASTDISK_SECTOR_SIZE ? rc : FASTDISK_SECTOR_SIZE);
+            disk->commitSector(&view);
+        } else {
+            mStatus = FASTDISK_ERROR;
+        }
+        if (++sector > FASTDISK_SECTORS) {
+            sector = 1;
+            track++;
+        }
+    }
+    mDataCount = 0;
+    mDataOffset = 0;
+
+#ifdef DEBUG_FASTDISK
+    Serial.printf("FASTDISK write: %d sectors, drive %d, track %d, sector %d, status %d\n", mParam[0], mParam[1], mParam[2], mParam[3],
+                  mStatus);
+#endif
+}
+
+// bit n: a disk is mounted on drive n
+uint8_t FASTDISK::driveStatus(void) {
+    uint8_t status = 0;
+    for (int i = 0; i < MAX_DRIVE; i++) {
+        if (mPD765C->getDisk(i)->isReady()) status |= 1 << i;
+    }
+    return status;
+}
@@ -0,0 +1,91 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <cstdint>
+
+#include "d88.h"
+#include "i8255.h"
+#include "pd765c.h"
+
+// Port C bits of the 8255 handshake, the same on both sides
+#define HS_ATN (0x80)  // Attention: the byte is a command
+#define HS_DAC (0x40)  // Data accepted
+#define HS_RFD (0x20)  // Ready for data
+#define HS_DAV (0x10)  // Data valid
+
+#define FASTDISK_SECTORS (16)
+#define FASTDISK_SECTOR_SIZE (256)
+
+// Result status of command 06h
+#define FASTDISK_OK (0x00)
+#define FASTDISK_ERROR (0x01)
+
+// High level emulation of the PC-80S31 command protocol. It answers the handshake of the main 8255
+// through the port B and C of the sub 8255, as the DISK.ROM does, and transfers whole sectors from
+// and to PC88D88. The commands that run code on the sub CPU are not emulated.
+// The sectors are transferred on the PC-8801 task: a track of an image which is not preloaded is read from the
+// micro SD card there, and the main CPU waits for it (and for a write back of the disk I/O task in progress).
+class FASTDISK {
+   public:
+    FASTDISK();
+    ~FASTDISK();
+
+    int init(I8255 *main, I8255 *sub, PD765C *fdc);
+    void reset(void);
+
+    // Called after each output to the main 8255
+    static void update(void *context);
+
+   private:
+    I8255 *mMain;
+    I8255 *mSub;
+    PD765C *mPD765C;
+
+    bool mSending;
+    uint8_t mCmd;
+    uint8_t mParam[4];
+    int mParamCount;
+    int mParamOffset;
+
+    uint8_t *mBuffer;  // sectors of command 01h and 02h
+    uint8_t mResult;   // a byte to send
+    uint8_t *mSendData;
+    int mDataCount;
+    int mDataOffset;
+    int mReadCount;
+
+    uint8_t mStatus;
+
+    void receive(uint8_t value, bool attention);
+    void command(uint8_t value);
+    void execute(void);
+    void send(uint8_t *data, int count);
+
+    void readSectors(void);
+    void writeSectors(void);
+    void setIO(d88_io_parameter_t *io, int track, int sector);
+    uint8_t driveStatus(void);
+};
@@ -24,6 +24,8 @@
 
 #include <Arduino.h>
 
+#include "snapshot.h"
+
 #ifdef DEBUG_PC88
 // #define DEBUG_I8255
 // #define DEBUG_PC80S31_CMD
@@ -90,6 +92,9 @@ I8255::I8255() {
     mATN = false;
 
     memset(&mCallBack, 0, sizeof(i8255_callback_t));
+
+    mOutCallBack = nullptr;
+    mOutContext = nullptr;
 }
 
 I8255::~I8255() {}
@@ -191,6 +196,8 @@ void I8255::out(int port, uint8_t value) {
             control(value);
             break;
     }
+
+    if (mOutCallBack) (*mOutCallBack)(mOutContext);
 }
 
 void I8255::control(uint8_t value) {
@@ -239,6 +246,11 @@ void I8255::setCallBack(i8255_callback_t *callBack, I8255 *i8255) {
     mI8255 = i8255;
 }
 
+void I8255::setOutCallBack(void (*outCallBack)(void *context), void *context) {
+    mOutCallBack = outCallBack;
+    mOutContext = context;
+}
+
 const char *I8255::getID() {
     switch (mID) {
         case I8255_PC8801:
@@ -250,3 +262,17 @@ const char *I8255::getID() {
     }
     return "unknown";
 }
+
+void I8255::snapshot(FILE *fp, bool save) {
+    SNAPSHOT_IO(fp, save, mPortA);
+    SNAPSHOT_IO(fp, save, mPortB);
+    SNAPSHOT_IO(fp, save, mPortC);
+    SNAPSHOT_IO(fp, save, mCmd);
+    SNAPSHOT_IO(fp, save, mPortAMode);
+    SNAPSHOT_IO(fp, save, mPortBMode);
+    SNAPSHOT_IO(fp, save, mPortCLowerMode);
+    SNAPSHOT_IO(fp, save, mPortCUpperMode);
+    SNAPSHOT_IO(fp, save, mGroupAMode);
+    SNAPSHOT_IO(fp, save, mGroupBMode);
+    SNAPSHOT_IO(fp, save, mATN);
+}
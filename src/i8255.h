@@ -25,6 +25,7 @@
 #pragma GCC optimize("O2")
 
 #include <cstdint>
+#include <cstdio>
 
 #define I8255_PORT_A 0
 #define I8255_PORT_B 1
@@ -56,16 +57,23 @@ class I8255 {
 
     void setCallBack(i8255_callback_t *callBack, I8255 *i8255);
 
+    // Called after each output, nullptr removes it
+    void setOutCallBack(void (*outCallBack)(void *context), void *context);
+
     uint8_t mPortA;
     uint8_t mPortB;
     uint8_t mPortC;
 
     void init(int value) { mID = value; }
+    void snapshot(FILE *fp, bool save);
 
    private:
     I8255 *mI8255;
     i8255_callback_t mCallBack;
 
+    void (*mOutCallBack)(void *context);
+    void *mOutContext;
+
     uint8_t mCmd;
 
     uint8_t mPortAMode;
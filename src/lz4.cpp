@@ -0,0 +1,145 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "lz4.h"
+
+#include <cstring>
+
+#define LZ4_MIN_MATCH (4)
+#define LZ4_LAST_LITERALS (5)  // the last bytes of a block are literals
+#define LZ4_MF_LIMIT (12)      // the last match starts before this many bytes from the end
+#define LZ4_MAX_OFFSET (65535)
+#define LZ4_HASH_BITS (12)
+
+int LZ4::decompress(const uint8_t *src, int srcSize, uint8_t *dest, int destSize) {
+    auto ip = src;
+    auto iend = src + srcSize;
+    auto op = dest;
+    auto oend = dest + destSize;
+
+    while (ip < iend) {
+        auto token = *ip++;
+
+        int length = token >> 4;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        if (length > iend - ip || length > oend - op) return -1;
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+
+        // the last sequence has no match
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dest) return -1;
+
+        length = token & 0x0f;
+        if (length == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        length += LZ4_MIN_MATCH;
+        if (length > oend - op) return -1;
+
+        // the match may overlap the output
+        auto match = op - offset;
+        for (int i = 0; i < length; i++) *op++ = *match++;
+    }
+
+    return op - dest;
+}
+
+static uint8_t *writeLength(uint8_t *op, int length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = length;
+    return op;
+}
+
+// One sequence: the literals, then a match unless matchLength is 0
+static uint8_t *writeSequence(uint8_t *op, const uint8_t *literals, int literalLength, int offset, int matchLength) {
+    auto token = op++;
+    *token = (literalLength < 15 ? literalLength : 15) << 4;
+    if (literalLength >= 15) op = writeLength(op, literalLength - 15);
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+
+    if (matchLength > 0) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        matchLength -= LZ4_MIN_MATCH;
+        *token |= matchLength < 15 ? matchLength : 15;
+        if (matchLength >= 15) op = writeLength(op, matchLength - 15);
+    }
+    return op;
+}
+
+// Greedy parser with a hash table of the last positions of 4 byte sequences
+int LZ4::compress(const uint8_t *src, int srcSize, uint8_t *dest, int destSize) {
+    if (destSize < compressBound(srcSize)) return -1;
+
+    static int32_t table[1 << LZ4_HASH_BITS];
+    for (int i = 0; i < (1 << LZ4_HASH_BITS); i++) table[i] = -1;
+
+    auto op = dest;
+    int anchor = 0;
+    int ip = 0;
+    int limit = srcSize - LZ4_MF_LIMIT;
+
+    while (ip < limit) {
+        uint32_t sequence;
+        memcpy(&sequence, src + ip, 4);
+        auto hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+        auto ref = table[hash];
+        table[hash] = ip;
+
+        if (ref < 0 || ip - ref > LZ4_MAX_OFFSET || memcmp(src + ref, src + ip, 4)) {
+            ip++;
+            continue;
+        }
+
+        int length = LZ4_MIN_MATCH;
+        while (ip + length < srcSize - LZ4_LAST_LITERALS && src[ref + length] == src[ip + length]) length++;
+
+        op = writeSequence(op, src + anchor, ip - anchor, ip - ref, length);
+        ip += length;
+        anchor = ip;
+    }
+
+    op = writeSequence(op, src + anchor, srcSize - anchor, 0, 0);
+    return op - dest;
+}
@@ -0,0 +1,57 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <cstdint>
+
+// Compressed image container: the header, the frame index, then the frames.
+// A frame is one LZ4 block, or the raw data when compressedSize == size.
+// The frames cover the decompressed image in order, d88pack makes a frame of each track.
+#define LZ4_CONTAINER_ID "PC88LZ4"
+#define LZ4_CONTAINER_EXT ".lz4"
+
+typedef struct {
+    char id[8];
+    uint32_t size;    // decompressed size
+    uint32_t frames;  // number of frames
+} lz4_container_t;
+
+typedef struct {
+    uint32_t offset;  // offset in the decompressed image
+    uint32_t size;
+    uint32_t fileOffset;  // offset of the frame in the container
+    uint32_t compressedSize;
+} lz4_frame_t;
+
+// LZ4 block format without the frame format
+class LZ4 {
+   public:
+    // Returns the decompressed size, or -1 for broken data or a small dest
+    static int decompress(const uint8_t *src, int srcSize, uint8_t *dest, int destSize);
+
+    // Returns the compressed size, or -1 when dest is smaller than compressBound()
+    static int compress(const uint8_t *src, int srcSize, uint8_t *dest, int destSize);
+    static int compressBound(int size) { return size + size / 255 + 16; }
+};
@@ -22,6 +22,7 @@
 
 #include "d88.h"
 #include "pc88vm.h"
+#include "snapshot.h"
 
 #ifdef DEBUG_PC88
 // #define DEBUG_PC80S31
@@ -32,6 +33,7 @@ PC80S31::~PC80S31(){};
 
 int PC80S31::init(PC88VM *vm, uint8_t *mem, I8255 *i8255) {
     mMem = mem;
+    mMainI8255 = i8255;
 
     mI8255 = new I8255;
 
@@ -51,10 +53,27 @@ int PC80S31::init(PC88VM *vm, uint8_t *mem, I8255 *i8255) {
 
     mPD765C = new PD765C;
     mPD765C->setIRQFlag(&mIRQ);
+    mPD765C->setWakeUp(outCallBack, this);
+    mPD765C->run();
+
+    mFASTDISK = new FASTDISK;
+    if (mFASTDISK->init(i8255, mI8255, mPD765C) < 0) {
+        delete mFASTDISK;
+        mFASTDISK = nullptr;
+    }
+    mFastDisk = false;
 
     mPD780C = new fabgl::Z80;
     mPD780C->setCallbacks(this, readByte, writeByte, readWord, writeWord, readIO, writeIO);
 
+    mRunning = false;
+    mPause = false;
+    mPaused = false;
+
+    mTaskHandle = nullptr;
+    mPollCount = 0;
+    mMainI8255->setOutCallBack(outCallBack, this);
+
 #ifdef DEBUG_PC80S31
     Serial.println("PC-80S31 init completed");
 #endif
@@ -62,31 +81,124 @@ int PC80S31::init(PC88VM *vm, uint8_t *mem, I8255 *i8255) {
     return 0;
 }
 
-void PC80S31::reset(void) { mReset = true; }
+void PC80S31::reset(void) {
+    mReset = true;
+    if (mFastDisk) mFASTDISK->reset();
+    wakeUp();
+}
 
 int IRAM_ATTR PC80S31::run(void) {
+    mTaskHandle = xTaskGetCurrentTaskHandle();
+    boot();
+    mRunning = true;
+
+    while (true) {
+        if (mPause) {
+            mPaused = true;
+            while (mPause) delay(1);
+            mPaused = false;
+        }
+        if (mFastDisk) {
+            // FASTDISK answers on the PC-8801 task, pause() and setFastDisk() wake the task up
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PC80S31_IDLE_TIMEOUT));
+            continue;
+        }
+        step();
+        if (isIdle()) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PC80S31_IDLE_TIMEOUT));
+            mPollCount = 0;
+        }
+    }
+}
+
+// Stop the sub CPU loop between instructions, returns when it is stopped
+void PC80S31::pause(bool value) {
+    mPause = value;
+    wakeUp();
+    if (value && mRunning) {
+        while (!mPaused) delay(1);
+    }
+}
+
+void PC80S31::setFastDisk(bool value) {
+    if (mFASTDISK == nullptr) value = false;
+    if (value == mFastDisk) return;
+
+    mFastDisk = value;
+    if (value) {
+        mFASTDISK->reset();
+        mMainI8255->setOutCallBack(FASTDISK::update, mFASTDISK);
+    } else {
+        mMainI8255->setOutCallBack(outCallBack, this);
+        mI8255->mPortB = 0;
+        mI8255->mPortC = 0;
+        mReset = true;
+        wakeUp();
+    }
+
+#ifdef DEBUG_PC80S31
+    Serial.printf("PC-80S31 fast disk: %d\n", value);
+#endif
+}
+
+// Count the 8255 reads that return the same value from the same loop
+uint8_t IRAM_ATTR PC80S31::poll(uint8_t value) {
+    auto pc = mPD780C->getPC();
+    if (value == mPollValue && (uint16_t)(pc - mPollPC + PC80S31_IDLE_RANGE) <= PC80S31_IDLE_RANGE * 2) {
+        mPollCount++;
+    } else {
+        mPollPC = pc;
+        mPollValue = value;
+        mPollCount = 0;
+    }
+    return value;
+}
+
+// Polling the 8255 or halted, and no interrupt from the FDC to serve, or waiting for the FDC to load a track
+bool IRAM_ATTR PC80S31::isIdle(void) {
+    if (mIRQ) return false;
+    if (mPD765C->isWaiting()) return true;
+    return mPollCount >= PC80S31_IDLE_POLLS || mPD780C->getStatus() == fabgl::Z80_STATUS_HALT;
+}
+
+void PC80S31::wakeUp(void) {
+    if (mTaskHandle) xTaskNotifyGive(mTaskHandle);
+}
+
+void PC80S31::outCallBack(void *context) { ((PC80S31 *)context)->wakeUp(); }
+
+void PC80S31::boot(void) {
     mIRQ = false;
     mReset = false;
 
+    mPD765C->reset();
     mPD780C->reset();
     mPD780C->setPC(0);
+}
 
-    while (true) {
-        if (mPD780C->getStatus() == fabgl::Z80_STATUS_HALT) {
-            if (mPD780C->getIFF1() && mIRQ) {
-                mPD780C->IRQ(0x00);
-                mIRQ = false;
-            }
-        } else {
-            mPD780C->step();
-        }
-        if (mReset) {
-            mReset = false;
+// One instruction of the sub CPU, returns T-states. A halted CPU spends 4 T-states like a NOP.
+int IRAM_ATTR PC80S31::step(void) {
+    int cycles = 4;
+
+    mPD765C->update();
+
+    if (mPD780C->getStatus() == fabgl::Z80_STATUS_HALT) {
+        if (mPD780C->getIFF1() && mIRQ) {
+            cycles = mPD780C->IRQ(0x00);
             mIRQ = false;
-            mPD780C->reset();
-            mPD780C->setPC(0);
         }
+    } else {
+        cycles = mPD780C->step();
     }
+    if (mReset) {
+        mReset = false;
+        mIRQ = false;
+        mPD765C->reset();
+        mPD780C->reset();
+        mPD780C->setPC(0);
+    }
+
+    return cycles;
 }
 
 int IRAM_ATTR PC80S31::readByte(void *context, int address) {
@@ -121,11 +233,11 @@ int PC80S31::readIO(void *context, int address) {
         case 0xfb:
             return vm->mPD765C->readDataRegister();
         case 0xfc:
-            return vm->mI8255->in(I8255_PORT_A);
+            return vm->poll(vm->mI8255->in(I8255_PORT_A));
         case 0xfd:
             return vm->mI8255->in(I8255_PORT_B);
         case 0xfe:
-            return vm->mI8255->in(I8255_PORT_C);
+            return vm->poll(vm->mI8255->in(I8255_PORT_C));
         case 0xff:
             return vm->mI8255->in(I8255_PORT_CONTROL);
         default:
@@ -141,6 +253,8 @@ int PC80S31::readIO(void *context, int address) {
 void PC80S31::writeIO(void *context, int address, int value) {
     auto vm = (PC80S31 *)context;
 
+    vm->mPollCount = 0;
+
     switch (address) {
         case 0xf4:
             vm->mPD765C->writeF4(value);
@@ -174,8 +288,38 @@ void PC80S31::writeIO(void *context, int address, int value) {
     }
 }
 
-int PC80S31::openDrive(int drive, char *fileName) { return mPD765C->openDrive(drive, fileName); }
+// The sub CPU is stopped while a disk is changed, a sector transfer may use the memory of the image
+int PC80S31::openDrive(int drive, char *fileName, int image) {
+    pause(true);
+    auto ret = mPD765C->openDrive(drive, fileName, image);
+    pause(false);
+    return ret;
+}
 
-int PC80S31::closeDrive(int drive) { return mPD765C->closeDrive(drive); }
+int PC80S31::closeDrive(int drive) {
+    pause(true);
+    auto ret = mPD765C->closeDrive(drive);
+    pause(false);
+    return ret;
+}
+
+void PC80S31::eject(void) {
+    pause(true);
+    mPD765C->eject();
+    pause(false);
+}
 
-void PC80S31::eject(void) { mPD765C->eject(); }
\ No newline at end of file
+void PC80S31::flush(void) { mPD765C->flush(); }
+
+void PC80S31::snapshot(FILE *fp, bool save) {
+    mPD765C->complete();
+
+    SNAPSHOT::z80(fp, save, mPD780C);
+    mPD780C->setCallbacks(this, readByte, writeByte, readWord, writeWord, readIO, writeIO);
+
+    SNAPSHOT_IO(fp, save, mIRQ);
+    SNAPSHOT_BLOCK(fp, save, mMem + 0x4000, 0x4000);
+
+    mI8255->snapshot(fp, save);
+    mPD765C->snapshot(fp, save);
+}
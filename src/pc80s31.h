@@ -25,6 +25,7 @@
 #pragma GCC optimize("O2")
 
 #include "d88.h"
+#include "fastdisk.h"
 #include "pc88vm.h"
 #include "pd765c.h"
 
@@ -32,6 +33,12 @@ class PC88VM;
 
 #define DRIVES 4
 
+// The sub CPU is idle when it reads the same value from the 8255 PC80S31_IDLE_POLLS times within
+// PC80S31_IDLE_RANGE bytes of code, it sleeps until the main CPU writes to its 8255 or the timeout (ms)
+#define PC80S31_IDLE_RANGE (0x20)
+#define PC80S31_IDLE_POLLS (64)
+#define PC80S31_IDLE_TIMEOUT (10)
+
 class PC80S31 {
    public:
     PC80S31();
@@ -40,6 +47,8 @@ class PC80S31 {
     int init(PC88VM *vm, uint8_t *mem, I8255 *i8255);
     void reset(void);
     int run(void);
+    void boot(void);
+    int step(void);
 
     static int readByte(void *context, int address);
     static void writeByte(void *context, int address, int value);
@@ -50,18 +59,44 @@ class PC80S31 {
     static int readIO(void *context, int address);
     static void writeIO(void *context, int address, int value);
 
-    int openDrive(int drive, char *fileName);
+    int openDrive(int drive, char *fileName, int image = 0);
     int closeDrive(int drive);
 
     void eject(void);
+    void flush(void);
+
+    void pause(bool value);
+
+    // Answer the commands of the main CPU at the 8255 instead of running the sub CPU
+    void setFastDisk(bool value);
+    bool isFastDisk(void) { return mFastDisk; }
+
+    void snapshot(FILE *fp, bool save);
 
    private:
     fabgl::Z80 *mPD780C;
     I8255 *mI8255;
+    I8255 *mMainI8255;
     PD765C *mPD765C;
+    FASTDISK *mFASTDISK;
+    volatile bool mFastDisk;
 
     bool mReset;
     bool mIRQ;
 
+    bool mRunning;
+    volatile bool mPause;
+    volatile bool mPaused;
+
+    TaskHandle_t mTaskHandle;
+    uint16_t mPollPC;
+    uint8_t mPollValue;
+    int mPollCount;
+
+    uint8_t poll(uint8_t value);
+    bool isIdle(void);
+    void wakeUp(void);
+    static void outCallBack(void *context);
+
     uint8_t *mMem;
 };
@@ -309,4 +309,14 @@ void IRAM_ATTR PC88KeyBoard::updateKeyMap(bool keyUp, int scanCode) {
     }
 }
 
-void PC88KeyBoard::setPadEnter(bool value) { mPadEnter = value; }
\ No newline at end of file
+void PC88KeyBoard::setPadEnter(bool value) { mPadEnter = value; }
+
+// Scan code of a PC-8801 key by the name in scanCodeTable, -1 if not found
+int PC88KeyBoard::findKey(const char *name) {
+    for (int i = 0; i < 512; i++) {
+        if (scanCodeTable[i].data && !strcasecmp(scanCodeTable[i].name, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
\ No newline at end of file
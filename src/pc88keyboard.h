@@ -43,6 +43,9 @@ class PC88KeyBoard {
     void reset(void);
     void setPadEnter(bool value);
 
+    static int findKey(const char *name);
+    static void updateKeyMap(bool keyUp, int scanCode);
+
    private:
     fabgl::PS2Controller PS2Controller;
 
@@ -76,5 +79,4 @@ class PC88KeyBoard {
     void *mArg;
 
     static void keyBoardTask(void *pvParameters);
-    static void updateKeyMap(bool keyUp, int scanCode);
 };
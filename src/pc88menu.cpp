@@ -24,6 +24,7 @@
 
 #include <Update.h>
 
+#include "cmt-image.h"
 #include "d88.h"
 #include "file-stream.h"
 
@@ -45,6 +46,7 @@ PC88MENU::~PC88MENU() {}
 #define LINE_MODE (4)
 #define EXTRAM_MODE (5)
 #define PCG_MODE (6)
+#define FASTDISK_MODE (7)
 
 #define MENU_MISC_SETTINGS (0)
 #define MENU_BASIC_MODE (1)
@@ -55,9 +57,12 @@ PC88MENU::~PC88MENU() {}
 #define MENU_DRIVE_2 (6)
 #define MENU_DRIVE_3 (7)
 #define MENU_LOAD_N80_FILE (8)
-#define MENU_PC88_RESET (9)
-#define MENU_PC88_COLD_BOOT (10)
-#define MENU_ESP32_RESTART (11)
+#define MENU_LOAD_CMT_FILE (9)
+#define MENU_SAVE_SNAPSHOT (10)
+#define MENU_LOAD_SNAPSHOT (11)
+#define MENU_PC88_RESET (12)
+#define MENU_PC88_COLD_BOOT (13)
+#define MENU_ESP32_RESTART (14)
 
 #define MENU_FILE_MANAGER (0)
 #define MENU_CPU_SPEED (1)
@@ -68,7 +73,9 @@ PC88MENU::~PC88MENU() {}
 #define MENU_EXTRAM (6)
 #define MENU_PCG (7)
 #define MENU_PAD_ENTER (8)
-#define MENU_UPDATE_FW (9)
+#define MENU_FAST_DISK (9)
+#define MENU_FAST_TAPE (10)
+#define MENU_UPDATE_FW (11)
 
 #define MENU_CREATE_TAPE (0)
 #define MENU_RENAME_TAPE (1)
@@ -95,7 +102,7 @@ int PC88MENU::menu(PC88VM *vm) {
     do {
         sprintf(mMenuItem,
                 "Miscellaneous settings;BASIC: %s;TAPE: %s;DISK: %s;Drive1: %s;Drive2: %s;Drive3: %s;Drive4: %s;Load n80 "
-                "file;PC-8801 reset;PC-8801 cold boot;ESP32 reset",
+                "file;Load cmt file;Save snapshot;Load snapshot;PC-8801 reset;PC-8801 cold boot;ESP32 reset",
                 getMode(BASIC_MODE, current->n88, pc88Settings->getN88()), current->tape,
                 getMode(DISK_MODE, current->drive, pc88Settings->getDrive()), current->disk[0], current->disk[1], current->disk[2],
                 current->disk[3]);
@@ -133,6 +140,15 @@ int PC88MENU::menu(PC88VM *vm) {
             case MENU_LOAD_N80_FILE:
                 rc = loadN80File(&ib);
                 break;
+            case MENU_LOAD_CMT_FILE:
+                rc = loadCmtFile(&ib);
+                break;
+            case MENU_SAVE_SNAPSHOT:
+                rc = saveSnapshot(&ib);
+                break;
+            case MENU_LOAD_SNAPSHOT:
+                rc = loadSnapshot(&ib);
+                break;
             case MENU_PC88_RESET:
                 rc = CMD_RESET;
                 break;
@@ -158,11 +174,12 @@ int PC88MENU::miscSettings(fabgl::InputBox *ib) {
     do {
         sprintf(mMenuItem,
                 "File Manager;CPU speed: %s;Volume %d;Columns: %s;Rows: %s;Resolution (Hsync): %s;PC-8801-02N (ExtRAM): %s;PCG: "
-                "%s;Behavior of PAD enter key: %s;Update firmware",
+                "%s;Behavior of PAD enter key: %s;Fast disk: %s;Fast tape: %s;Update firmware",
                 cpuSpeedStr(current->speed), current->volume, getMode(COLUMN_MODE, current->column40, pc88Settings->getColumn()),
                 getMode(ROW_MODE, current->row20, pc88Settings->getRow()), getMode(LINE_MODE, current->line200, pc88Settings->getLine200()),
                 getMode(EXTRAM_MODE, current->extRam, pc88Settings->getExtRAM()), getMode(PCG_MODE, current->pcg, pc88Settings->getPCG()),
-                current->padEnter ? "Behave as equal key (=)" : "Behave as RETURN key");
+                current->padEnter ? "Behave as equal key (=)" : "Behave as RETURN key",
+                getMode(FASTDISK_MODE, current->fastDisk, pc88Settings->getFastDisk()), current->fastTape ? "Enable" : "Disable");
         rc = ib->menu(mMenuTitle, "Select an item", mMenuItem);
         switch (rc) {
             case MENU_FILE_MANAGER:
@@ -206,6 +223,18 @@ int PC88MENU::miscSettings(fabgl::InputBox *ib) {
                 pc88Settings->save();
                 rc = MENU_CONTINUE;
                 break;
+            case MENU_FAST_DISK:
+                pc88Settings->setFastDisk(!pc88Settings->getFastDisk());
+                pc88Settings->save();
+                rc = MENU_CONTINUE;
+                break;
+            case MENU_FAST_TAPE:
+                current->fastTape = !current->fastTape;
+                pc88Settings->setFastTape(current->fastTape);
+                mVM->getDR320()->setFastTape(current->fastTape);
+                pc88Settings->save();
+                rc = MENU_CONTINUE;
+                break;
             case MENU_UPDATE_FW:
                 rc = updateFirmware(ib);
                 break;
@@ -218,11 +247,17 @@ int PC88MENU::miscSettings(fabgl::InputBox *ib) {
 int PC88MENU::diskSelector(fabgl::InputBox *ib, PC88SETTINGS *pc88Settings, int driveNo, char *driveStr) {
     if (strlen(driveStr) > 0) {
         sprintf(mMenuMsg, "Eject the disk file for drive %d", driveNo + 1);
-        sprintf(mMenuItem, "Eject: %s", driveStr);
+        if (pc88Settings->getImage(driveNo) > 0) {
+            sprintf(mMenuItem, "Eject: %s (image %d)", driveStr, pc88Settings->getImage(driveNo) + 1);
+        } else {
+            sprintf(mMenuItem, "Eject: %s", driveStr);
+        }
         auto value = ib->menu(mMenuTitle, mMenuMsg, mMenuItem);
         if (value == 0) {
             strcpy(driveStr, "");
             pc88Settings->setDisk(driveNo, driveStr);
+            pc88Settings->setImage(driveNo, 0);
+            mVM->getCurrentSettings()->image[driveNo] = 0;
             pc88Settings->save();
             mVM->getPC80S31()->closeDrive(driveNo);
         }
@@ -236,19 +271,51 @@ int PC88MENU::diskSelector(fabgl::InputBox *ib, PC88SETTINGS *pc88Settings, int
         auto rc = ib->fileSelector(mMenuMsg, "Filename: ", mPath, sizeof(mPath) - 1, mFileName, sizeof(mFileName) - 1);
         if (rc == InputResult::Enter && strlen(mFileName) > 0) {
             const char *ext = strrchr(mFileName, '.');
-            if (ext == nullptr || strcasecmp(ext, ".d88")) return MENU_CONTINUE;
+            if (ext == nullptr || (strcasecmp(ext, ".d88") && strcasecmp(ext, LZ4_CONTAINER_EXT))) return MENU_CONTINUE;
 
-            strcpy(driveStr, mPath);
-            strcat(driveStr, "/");
-            strcat(driveStr, mFileName);
+            strcpy(mPath2, mPath);
+            strcat(mPath2, "/");
+            strcat(mPath2, mFileName);
+            auto image = selectImage(ib, mPath2);
+            if (image < 0) return MENU_CONTINUE;
+
+            strcpy(driveStr, mPath2);
             pc88Settings->setDisk(driveNo, driveStr);
+            pc88Settings->setImage(driveNo, image);
+            mVM->getCurrentSettings()->image[driveNo] = image;
             pc88Settings->save();
-            mVM->getPC80S31()->openDrive(driveNo, driveStr);
+            mVM->getPC80S31()->openDrive(driveNo, driveStr, image);
         }
     }
     return MENU_CONTINUE;
 }
 
+// The image of a multi-volume D88 file, 0 for a single image, -1 when cancelled or broken
+int PC88MENU::selectImage(fabgl::InputBox *ib, const char *fileName) {
+    static const char *typeName[] = {"2D", "2DD", "2HD"};
+    d88_image_t images[D88_MAX_IMAGE];
+
+    auto count = PC88D88::getImages(fileName, images, D88_MAX_IMAGE);
+    if (count <= 0) {
+        ib->message("Error: not a d88 file", fileName, nullptr);
+        return -1;
+    }
+    if (count == 1) return 0;
+
+    mMenuItem[0] = 0;
+    for (int i = 0; i < count; i++) {
+        for (auto p = images[i].name; *p; p++) {
+            if (*p == ';') *p = ' ';
+        }
+        auto type = images[i].diskType >> 4;
+        char item[64];
+        sprintf(item, "%d: %s (%s)", i + 1, strlen(images[i].name) > 0 ? images[i].name : "No name", type < 3 ? typeName[type] : "?");
+        if (i > 0) strcat(mMenuItem, ";");
+        strcat(mMenuItem, item);
+    }
+    return ib->menu(mMenuTitle, "Select the disk image", mMenuItem);
+}
+
 int PC88MENU::tapeSelector(fabgl::InputBox *ib, pc88_settings_t *current, PC88SETTINGS *pc88Settings) {
     if (!strcmp("", current->tape)) {
         strcpy(mPath, SD_MOUNT_POINT);
@@ -258,7 +325,7 @@ int PC88MENU::tapeSelector(fabgl::InputBox *ib, pc88_settings_t *current, PC88SE
         auto rc = ib->fileSelector("Select tape file to load", "Filename: ", mPath, sizeof(mPath) - 1, mFileName, sizeof(mFileName) - 1);
         if (rc == InputResult::Enter && strcmp("", mFileName)) {
             const char *ext = strrchr(mFileName, '.');
-            if (ext == nullptr || strcasecmp(ext, ".cmt")) return MENU_CONTINUE;
+            if (ext == nullptr || (strcasecmp(ext, ".cmt") && strcasecmp(ext, ".t88") && strcasecmp(ext, ".wav"))) return MENU_CONTINUE;
 
             strcpy(current->tape, mPath);
             strcat(current->tape, "/");
@@ -334,6 +401,104 @@ const int PC88MENU::loadN80File(fabgl::InputBox *ib) {
 
     return MENU_CONTINUE;
 }
+// The program of a cmt file is put into RAM at once as by CLOAD, machine code may be started at an address
+int PC88MENU::loadCmtFile(fabgl::InputBox *ib) {
+    strcpy(mPath, SD_MOUNT_POINT);
+    strcat(mPath, PC88DIR);
+    strcat(mPath, PC88DIR_TAPE);
+    strcpy(mFileName, "");
+
+    auto rc = ib->fileSelector("Select the cmt file", "Filename: ", mPath, sizeof(mPath) - 1, mFileName, sizeof(mFileName) - 1);
+
+    if (rc == InputResult::Enter && strlen(mFileName) > 0) {
+        const char *ext = strrchr(mFileName, '.');
+        if (ext == nullptr || strcasecmp(ext, ".cmt")) return MENU_CONTINUE;
+
+        strcat(mPath, "/");
+        strcat(mPath, mFileName);
+
+        uint16_t start = 0;
+        switch (CmtImage::load(mPath, mVM->getRAM(), mVM->getCurrentSettings()->n88, &start)) {
+            case CMT_IMAGE_BASIC:
+                return MENU_EXIT;
+            case CMT_IMAGE_MACHINE:
+                sprintf(mFileName, "%04X", start);
+                if (ib->textInput("Machine code loaded", "Start address (hex)", mFileName, 4, "Cancel", "Start") == InputResult::Enter &&
+                    strlen(mFileName) > 0) {
+                    mVM->setStartAddress(strtol(mFileName, nullptr, 16));
+                    return CMD_CMT_FILE;
+                }
+                return MENU_EXIT;
+            case CMT_IMAGE_CHECKSUM_ERROR:
+                ib->message("Error: checksum error", mPath, nullptr);
+                break;
+            case CMT_IMAGE_NO_BASIC:
+                ib->message("Error: start BASIC before loading", mPath, nullptr);
+                break;
+            default:
+                ib->message("Error: not a BASIC or machine code tape", mPath, nullptr);
+                break;
+        }
+    }
+
+    return MENU_CONTINUE;
+}
+
+int PC88MENU::saveSnapshot(fabgl::InputBox *ib) {
+    strcpy(mFileName, "");
+
+    if (ib->textInput("Save snapshot", "file name", mFileName, 31, nullptr, "OK") != InputResult::Enter || strlen(mFileName) == 0) {
+        return MENU_CONTINUE;
+    }
+
+    strcpy(mPath, SD_MOUNT_POINT);
+    strcat(mPath, PC88DIR);
+    strcat(mPath, PC88DIR_SNAPSHOT);
+    strcat(mPath, "/");
+    strcat(mPath, mFileName);
+    strcat(mPath, ".SNP");
+
+    if (mVM->saveSnapshot(mPath) < 0) {
+        ib->message("Error: snapshot not saved", mPath, nullptr);
+        return MENU_CONTINUE;
+    }
+
+    return MENU_EXIT;
+}
+
+int PC88MENU::loadSnapshot(fabgl::InputBox *ib) {
+    strcpy(mPath, SD_MOUNT_POINT);
+    strcat(mPath, PC88DIR);
+    strcat(mPath, PC88DIR_SNAPSHOT);
+    strcpy(mFileName, "");
+
+    auto rc = ib->fileSelector("Select the snapshot", "Filename: ", mPath, sizeof(mPath) - 1, mFileName, sizeof(mFileName) - 1);
+
+    if (rc == InputResult::Enter && strlen(mFileName) > 0) {
+        const char *ext = strrchr(mFileName, '.');
+        if (ext == nullptr || strcasecmp(ext, ".snp")) return MENU_CONTINUE;
+
+        strcat(mPath, "/");
+        strcat(mPath, mFileName);
+
+        switch (mVM->loadSnapshot(mPath)) {
+            case 0:
+                return MENU_EXIT;
+            case -3:
+                ib->message("Error: other machine settings", mPath, nullptr);
+                break;
+            case -4:
+                ib->message("Error: broken snapshot, reset", mPath, nullptr);
+                return MENU_EXIT;
+            default:
+                ib->message("Error: not snapshot file", mPath, nullptr);
+                break;
+        }
+    }
+
+    return MENU_CONTINUE;
+}
+
 int PC88MENU::updateFirmware(fabgl::InputBox *ib) {
     strcpy(mPath, SD_MOUNT_POINT);
     strcat(mPath, "/bin");
@@ -501,7 +666,9 @@ int PC88MENU::createDisk(fabgl::InputBox *ib, pc88_settings_t *current, PC88SETT
         for (int i = 0; i < 4; i++) {
             if (strlen(current->disk[i]) == 0) {
                 strcpy(current->disk[i], mPath);
+                current->image[i] = 0;
                 pc88Settings->setDisk(i, mPath);
+                pc88Settings->setImage(i, 0);
                 pc88Settings->save();
                 mVM->getPC80S31()->openDrive(i, mPath);
                 rc = MENU_EXIT;
@@ -748,7 +915,8 @@ const char *PC88MENU::getMode(int mode, bool cur, bool next) {
                                    {"High (24.8kHz)", "Normal (15.7kHz)", "High (24.8kHz) (15.7kHz when next cold boot)",
                                     "Normal (15.7kHz) (24.8kHz when next cold boot)"},
                                    {"Disable", "Enable", "Disable (Enable when next cold boot)", "Enable (Disable when next cold boot)"},
-                                   {"Auto", "On", "Auto (On when next cold boot)", "On (Auto when next cold boot)"}};
+                                   {"Auto", "On", "Auto (On when next cold boot)", "On (Auto when next cold boot)"},
+                                   {"Disable", "Enable", "Disable (Enable when next cold boot)", "Enable (Disable when next cold boot)"}};
 
     int index = 0;
 
@@ -32,9 +32,13 @@ class PC88MENU {
 
     int diskSelector(fabgl::InputBox *ib, PC88SETTINGS *pc88Settings, int drive, char *driveStr);
     int tapeSelector(fabgl::InputBox *ib, pc88_settings_t *current, PC88SETTINGS *pc88Settings);
+    int selectImage(fabgl::InputBox *ib, const char *fileName);
 
     const char *getMode(int mode, bool cur, bool next);
     const int loadN80File(fabgl::InputBox *ib);
+    int loadCmtFile(fabgl::InputBox *ib);
+    int saveSnapshot(fabgl::InputBox *ib);
+    int loadSnapshot(fabgl::InputBox *ib);
 
     int miscSettings(fabgl::InputBox *ib);
     int updateFirmware(fabgl::InputBox *ib);
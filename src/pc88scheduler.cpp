@@ -0,0 +1,79 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "pc88scheduler.h"
+
+// Events are kept in T-states of the main CPU. The clock wraps around,
+// so times are always compared by their signed difference.
+
+PC88SCHEDULER::PC88SCHEDULER() { reset(0); }
+PC88SCHEDULER::~PC88SCHEDULER() {}
+
+void PC88SCHEDULER::reset(uint32_t clock) {
+    mClock = clock;
+    for (int i = 0; i < SCHED_EVENTS; i++) {
+        mTime[i] = 0;
+        mActive[i] = false;
+    }
+    update();
+}
+
+void PC88SCHEDULER::schedule(int event, uint32_t clock) {
+    mTime[event] = clock;
+    mActive[event] = true;
+    update();
+}
+
+void PC88SCHEDULER::cancel(int event) {
+    mActive[event] = false;
+    update();
+}
+
+// Returns the earliest event which is due at the clock, or -1
+int PC88SCHEDULER::pop(uint32_t clock) {
+    mClock = clock;
+
+    int event = -1;
+    for (int i = 0; i < SCHED_EVENTS; i++) {
+        if (mActive[i] && (int32_t)(clock - mTime[i]) >= 0) {
+            if (event < 0 || (int32_t)(mTime[i] - mTime[event]) < 0) {
+                event = i;
+            }
+        }
+    }
+
+    if (event >= 0) {
+        mActive[event] = false;
+        update();
+    }
+
+    return event;
+}
+
+void PC88SCHEDULER::update(void) {
+    mNext = mClock + 0x7fffffff;
+    for (int i = 0; i < SCHED_EVENTS; i++) {
+        if (mActive[i] && (int32_t)(mTime[i] - mNext) < 0) {
+            mNext = mTime[i];
+        }
+    }
+}
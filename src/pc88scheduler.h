@@ -0,0 +1,63 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <cstdint>
+
+// Main CPU clock (T-states)
+#define CPU_CLOCK (4000000)
+#define CLOCK_CYCLES (CPU_CLOCK / 600)                // 600Hz timer interrupt
+#define FRAME_CYCLES (CLOCK_CYCLES * 10)              // 60Hz
+#define VRTC_CYCLES (FRAME_CYCLES * 45 / 525)         // vertical blanking of 640x480 60Hz
+#define CMT_CYCLES (CLOCK_CYCLES * 2)                 // 300Hz
+#define FRAME_TIME (16667)                            // micro seconds
+
+#define SCHED_VRTC_START 0
+#define SCHED_VRTC_END 1
+#define SCHED_CLOCK 2
+#define SCHED_CMT 3
+#define SCHED_EVENTS 4
+
+class PC88SCHEDULER {
+   public:
+    PC88SCHEDULER();
+    ~PC88SCHEDULER();
+
+    void reset(uint32_t clock);
+    void schedule(int event, uint32_t clock);
+    void cancel(int event);
+    int pop(uint32_t clock);
+
+    uint32_t next(void) { return mNext; }
+    uint32_t time(int event) { return mTime[event]; }
+
+   private:
+    uint32_t mTime[SCHED_EVENTS];
+    bool mActive[SCHED_EVENTS];
+    uint32_t mNext;
+    uint32_t mClock;
+
+    void update(void);
+};
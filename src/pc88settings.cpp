@@ -36,15 +36,19 @@
 
 #define SETTING_FILE_NAME "settings.ini"
 
-setting_type_t PC88SETTINGS::settings[16] = {
+setting_type_t PC88SETTINGS::settings[22] = {
     {"N88", TYPE_BOOL, &mSettings.n88, nullptr},           {"PC80S31", TYPE_BOOL, &mSettings.drive, nullptr},
     {"PCG", TYPE_BOOL, &mSettings.pcg, nullptr},           {"COLUMN40", TYPE_BOOL, &mSettings.column40, nullptr},
     {"ROW20", TYPE_BOOL, &mSettings.row20, nullptr},       {"EXTRAM", TYPE_BOOL, &mSettings.extRam, nullptr},
     {"LINE200", TYPE_BOOL, &mSettings.line200, nullptr},   {"PADENTER", TYPE_BOOL, &mSettings.padEnter, nullptr},
-    {"SPEED", TYPE_INT, &mSettings.speed, &speedValidate}, {"VOLUME", TYPE_INT, &mSettings.volume, &volumeValidate},
-    {"ROM", TYPE_STRING, &mSettings.rom, nullptr},         {"TAPE", TYPE_STRING, &mSettings.tape, nullptr},
-    {"DISK0", TYPE_STRING, &mSettings.disk[0], nullptr},   {"DISK1", TYPE_STRING, &mSettings.disk[1], nullptr},
-    {"DISK2", TYPE_STRING, &mSettings.disk[2], nullptr},   {"DISK3", TYPE_STRING, &mSettings.disk[3], nullptr}};
+    {"FASTDISK", TYPE_BOOL, &mSettings.fastDisk, nullptr}, {"FASTTAPE", TYPE_BOOL, &mSettings.fastTape, nullptr},
+    {"SPEED", TYPE_INT, &mSettings.speed, &speedValidate},
+    {"VOLUME", TYPE_INT, &mSettings.volume, &volumeValidate}, {"ROM", TYPE_STRING, &mSettings.rom, nullptr},
+    {"TAPE", TYPE_STRING, &mSettings.tape, nullptr},       {"DISK0", TYPE_STRING, &mSettings.disk[0], nullptr},
+    {"DISK1", TYPE_STRING, &mSettings.disk[1], nullptr},   {"DISK2", TYPE_STRING, &mSettings.disk[2], nullptr},
+    {"DISK3", TYPE_STRING, &mSettings.disk[3], nullptr},   {"IMAGE0", TYPE_INT, &mSettings.image[0], &imageValidate},
+    {"IMAGE1", TYPE_INT, &mSettings.image[1], &imageValidate}, {"IMAGE2", TYPE_INT, &mSettings.image[2], &imageValidate},
+    {"IMAGE3", TYPE_INT, &mSettings.image[3], &imageValidate}};
 
 char PC88SETTINGS::fileName[64];
 pc88_settings_t PC88SETTINGS::mSettings;
@@ -58,8 +62,11 @@ int PC88SETTINGS::init(char *rootDir) {
     mSettings.extRam = false;
     mSettings.padEnter = false;
     mSettings.pcg = false;
+    mSettings.fastDisk = false;
+    mSettings.fastTape = false;
     mSettings.volume = 8;
     mSettings.speed = 1;
+    for (int i = 0; i < 4; i++) mSettings.image[i] = 0;
 
     char **items[] = {&mSettings.rom, &mSettings.tape, &mSettings.disk[0], &mSettings.disk[1], &mSettings.disk[2], &mSettings.disk[3]};
 
@@ -87,6 +94,7 @@ int PC88SETTINGS::init(char *rootDir) {
     for (int i = 1; i < 5; i++) {
         if (!PC88D88::exists(*items[i])) {
             strcpy(*items[i], "");
+            if (i >= 2) mSettings.image[i - 2] = 0;
             update = true;
         }
     }
@@ -247,4 +255,11 @@ void PC88SETTINGS::speedValidate(void *arg) {
     if (*value < 0 || *value > 9) {
         *value = 4;
     }
+}
+
+void PC88SETTINGS::imageValidate(void *arg) {
+    auto value = (int *)arg;
+    if (*value < 0 || *value >= D88_MAX_IMAGE) {
+        *value = 0;
+    }
 }
\ No newline at end of file
@@ -38,11 +38,14 @@ typedef struct {
     bool extRam;
     bool padEnter;
     bool pcg;
+    bool fastDisk;
+    bool fastTape;
     int volume;
     int speed;
     char *rom;
     char *tape;
     char *disk[4];
+    int image[4];  // image of a multi-volume D88 file
 } pc88_settings_t;
 
 typedef struct {
@@ -84,6 +87,12 @@ class PC88SETTINGS {
     static void setPCG(bool b) { mSettings.pcg = b; }
     static bool getPCG(void) { return mSettings.pcg; }
 
+    static void setFastDisk(bool b) { mSettings.fastDisk = b; }
+    static bool getFastDisk(void) { return mSettings.fastDisk; }
+
+    static void setFastTape(bool b) { mSettings.fastTape = b; }
+    static bool getFastTape(void) { return mSettings.fastTape; }
+
     static void setVolume(int vol) { mSettings.volume = vol; }
     static int getVolume(void) { return mSettings.volume; }
 
@@ -105,6 +114,11 @@ class PC88SETTINGS {
         }
     }
 
+    static void setImage(const int index, int image) {
+        if (0 <= index && index < 4) mSettings.image[index] = image;
+    }
+    static int getImage(const int index) { return mSettings.image[index]; }
+
     static pc88_settings_t *get(void) {
         auto dest = (pc88_settings_t *)heap_caps_malloc(sizeof(pc88_settings_t), MALLOC_CAP_SPIRAM);
         if (dest != nullptr) {
@@ -120,7 +134,7 @@ class PC88SETTINGS {
    private:
     static pc88_settings_t mSettings;
 
-    static setting_type_t settings[16];
+    static setting_type_t settings[22];
     static char fileName[64];
 
     static void loadBool(char *buf, int i);
@@ -136,6 +150,7 @@ class PC88SETTINGS {
 
     static void volumeValidate(void *arg);
     static void speedValidate(void *arg);
+    static void imageValidate(void *arg);
 
     static void setBool(char *buf, bool *b);
 };
\ No newline at end of file
@@ -23,12 +23,24 @@
 #include "pc88vm.h"
 
 #include "pc88error.h"
+#include "snapshot.h"
 
 #ifdef DEBUG_PC88
 // #define DEBUG_PC88VM
 #endif
 
-PC88VM::PC88VM() {}
+static uint32_t calcCRC32(uint32_t crc, const uint8_t *p, size_t size) {
+    crc = ~crc;
+    while (size--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+PC88VM::PC88VM() : mFrameDumped(false), mFrameDumpResult(0), mDumpFrame(0), mStartAddress(0) {}
 PC88VM::~PC88VM() {}
 
 int PC88VM::init(void) {
@@ -54,7 +66,7 @@ int PC88VM::init(void) {
 
     mPD780C = new fabgl::Z80;
 
-    mXQueue = xQueueCreate(10, sizeof(cpu_cmd_t));
+    mIntRequest = 0;
     mXQueueDebug = xQueueCreate(10, sizeof(debug_cmd_t));
 
     mPD8257 = new PD8257;
@@ -72,7 +84,7 @@ int PC88VM::init(void) {
     mPCG8800->init(mFontROM, mSettings->volume);
 
     mDR320 = new DR320;
-    mDR320->init(&mXQueue);
+    mDR320->init(&mIntRequest);
 
     mKeyboard = new PC88KeyBoard;
     mKeyboard->init(&mKeyMap[0], PC88VM::keyboardCallBack, this);
@@ -97,13 +109,12 @@ void PC88VM::coldBoot(void) {
 
     mHighResolution = !mSettings->line200;
 
+    mPC80S31->setFastDisk(mSettings->fastDisk);
+    mDR320->setFastTape(mSettings->fastTape);
+
     setCpuSpeed(mSettings->speed);
 
-    if (mHighResolution) {
-        mPD780C->setCallbacks(this, readByte, writeByte400, readWord, writeWord400, readIO, writeIO);
-    } else {
-        mPD780C->setCallbacks(this, readByte, writeByte200, readWord, writeWord200, readIO, writeIO);
-    }
+    setCpuCallbacks();
 
     mPCG8800->initFont();
 
@@ -127,18 +138,27 @@ void PC88VM::coldBoot(void) {
     reset();
 }
 
+void PC88VM::setCpuCallbacks(void) {
+    if (mHighResolution) {
+        mPD780C->setCallbacks(this, readByte, writeByte400, readWord, writeWord400, readIO, writeIO);
+    } else {
+        mPD780C->setCallbacks(this, readByte, writeByte200, readWord, writeWord200, readIO, writeIO);
+    }
+}
+
 void PC88VM::reset(void) {
 #ifdef DEBUG_PC88VM
     Serial.println("reset");
 #endif
 
     mPC80S31->reset();
+    mPC80S31->flush();
 
     mKeyboard->reset();
 
     for (int i = 0; i < 4; i++) {
         if (strlen(mSettings->disk[i]) > 0) {
-            mPC80S31->openDrive(i, mSettings->disk[i]);
+            mPC80S31->openDrive(i, mSettings->disk[i], mSettings->image[i]);
         }
     }
 
@@ -202,10 +222,13 @@ void PC88VM::reset(void) {
     }
     mPort40In |= 0x04;  // CMT
 
+    updateMemoryMap();
+
     mVRTC = false;
 
     mIntClock = false;
     mIntVRTC = false;
+    mIntRequest = 0;
 }
 
 void PC88VM::run(void) {
@@ -230,6 +253,142 @@ void PC88VM::run(void) {
 #endif
 }
 
+// Run the main CPU for a number of T-states and/or frames without wall clock pacing and live keyboard input.
+// Key events come from a script file. The sub CPU (PC-80S31) is stepped in lockstep with the main CPU.
+// The results are deterministic except for programs reading the calendar clock (PD1990).
+int PC88VM::runHeadless(uint64_t cycles, uint32_t frames, const char *scriptFileName, const char *loadFileName,
+                        const char *saveFileName) {
+    key_event_t *events = nullptr;
+    int eventCount = 0;
+
+    if (scriptFileName) {
+        events = (key_event_t *)ps_malloc(KEY_EVENTS_MAX * sizeof(key_event_t));
+        if (events == nullptr) return -1;
+        eventCount = loadKeyScript(scriptFileName, events);
+        if (eventCount < 0) {
+            free(events);
+            return eventCount;
+        }
+    }
+
+    init();
+
+    mNoWait = true;
+    mSuspending = false;
+
+    mPD780C->reset();
+    mPD780C->setPC(0);
+
+    initScheduler();
+
+    bool subCPU = mDiskROM != nullptr && !mPC80S31->isFastDisk();
+    if (subCPU) mPC80S31->boot();
+
+    if (loadFileName) {
+        auto ret = loadSnapshot(loadFileName);
+        if (ret < 0) {
+            if (events) free(events);
+            return ret;
+        }
+    }
+
+    uint32_t subClock = mClock;
+
+    uint64_t clock = 0;
+    uint64_t instructions = 0;
+    int next = 0;
+
+    auto start = esp_timer_get_time();
+
+    while ((cycles == 0 || clock < cycles) && (frames == 0 || mFrames < frames)) {
+        while (next < eventCount && events[next].frame <= mFrames) {
+            PC88KeyBoard::updateKeyMap(events[next].keyUp, events[next].scanCode);
+            next++;
+        }
+
+        auto prev = mClock;
+
+        mClock += mPD780C->step();
+
+        if ((int32_t)(mClock - mScheduler.next()) >= 0) {
+            dispatchEvents();
+        }
+
+        if (mIntRequest.load(std::memory_order_relaxed) && mPD780C->getIFF1()) {
+            acceptInterrupt();
+        }
+
+        clock += mClock - prev;
+        instructions++;
+
+        if (subCPU) {
+            while ((int32_t)(subClock - mClock) < 0) {
+                subClock += mPC80S31->step();
+            }
+        }
+    }
+
+    auto elapsed = esp_timer_get_time() - start;
+    if (elapsed <= 0) elapsed = 1;
+
+    Serial.printf("T-states: %llu, instructions: %llu, frames: %u\n", (unsigned long long)clock, (unsigned long long)instructions, mFrames);
+    Serial.printf("time: %.3f s, %.2f MIPS, %.1f fps, %.1f x real time\n", elapsed / 1000000.0, (double)instructions / elapsed,
+                  mFrames * 1000000.0 / elapsed, (double)clock / CPU_CLOCK * 1000000.0 / elapsed);
+    Serial.printf("RAM CRC32: %08x, GVRAM CRC32: %08x\n", calcCRC32(0, mTextRAM0000, 0x10000), calcCRC32(0, mGVRAM0, 0xc000));
+
+    if (events) free(events);
+
+    mPC80S31->flush();
+
+    if (saveFileName) return saveSnapshot(saveFileName);
+
+    return 0;
+}
+
+// Key script: "<frame> down|up <key name>" per line, in frame order, '#' starts a comment.
+// Key names are the names in scanCodeTable (e.g. "A", "ENTER", "LEFT SHIFT").
+int PC88VM::loadKeyScript(const char *fileName, key_event_t *events) {
+    auto fp = fopen(fileName, "r");
+    if (!fp) return -1;
+
+    char buf[128];
+    int count = 0;
+    int lineNo = 0;
+    uint32_t lastFrame = 0;
+
+    while (fgets(buf, sizeof(buf), fp)) {
+        lineNo++;
+
+        char *pos;
+        if ((pos = strchr(buf, '#')) != NULL) *pos = '\0';
+        if ((pos = strchr(buf, '\n')) != NULL) *pos = '\0';
+        if ((pos = strchr(buf, '\r')) != NULL) *pos = '\0';
+
+        unsigned int frame;
+        char action[8];
+        char name[64];
+        auto n = sscanf(buf, "%u %7s %63[^\n]", &frame, action, name);
+        if (n <= 0) continue;
+
+        auto scanCode = n == 3 ? PC88KeyBoard::findKey(name) : -1;
+        if (scanCode < 0 || (strcmp(action, "down") && strcmp(action, "up")) || frame < lastFrame || count >= KEY_EVENTS_MAX) {
+            Serial.printf("%s:%d: invalid key event\n", fileName, lineNo);
+            fclose(fp);
+            return -2;
+        }
+
+        events[count].frame = frame;
+        events[count].keyUp = !strcmp(action, "up");
+        events[count].scanCode = scanCode;
+        count++;
+        lastFrame = frame;
+    }
+
+    fclose(fp);
+
+    return count;
+}
+
 void PC88VM::keyboardCallBack(void *arg, int value) {
     auto vm = (PC88VM *)arg;
     vm->mKbCmd = value;
@@ -248,84 +407,260 @@ void IRAM_ATTR PC88VM::pc88Task(void *pvParameters) {
     vm->mPD780C->reset();
     vm->mPD780C->setPC(0);
 
-    int intCount = 0;
-    int cycles = 0;
-    int diff = 0;
-    uint32_t previousTime = micros();
+    vm->initScheduler();
 
     while (true) {
         if (vm->mSuspending) {
             vm->vmControl(vm);
-            previousTime = micros();
-            cycles = 0;
-            diff = 0;
+            vm->mFrameDeadline = micros();
         }
 
-        cycles += vm->mPD780C->step();
-        vm->mPD3301->updateVRAMcahce();
+        vm->mClock += vm->mPD780C->step();
 
-        if (cycles > 100) {
-            uint32_t currentTime = micros();
-            int d = currentTime - previousTime;
-            if (d < 0) diff = (0xFFFFFFFF - previousTime) + currentTime;
-            previousTime = currentTime;
-            diff += d;
+        if ((int32_t)(vm->mClock - vm->mScheduler.next()) >= 0) {
+            vm->dispatchEvents();
+        }
 
-            int wait = (cycles - d / 10) / vm->mWait;
-            if (wait > 0 & !vm->mNoWait) delayMicroseconds(wait);
-            cycles = 0;
+        if (vm->mIntRequest.load(std::memory_order_relaxed) && vm->mPD780C->getIFF1()) {
+            vm->acceptInterrupt();
         }
+    }
+}
 
-        if (diff > 1666) {  // 1/600 sec
-            if (vm->mIntClock) {
-                cpu_cmd_t msg;
-                msg.cmd = INT_CLOCK;
-                xQueueSend(vm->mXQueue, &msg, 0);
-            }
-            intCount++;
-            if (intCount % 2 == 0) {
-                vm->mDR320->interrupt();
-            }
-            if (intCount > 9) {
-                if (vm->mIntVRTC) {
-                    cpu_cmd_t msg;
-                    msg.cmd = INT_VTRC;
-                    xQueueSend(vm->mXQueue, &msg, 0);
+// Port e4h bit 0-1 is the interrupt level, the requests below the level are accepted.
+// Masked requests stay pending.
+void IRAM_ATTR PC88VM::acceptInterrupt(void) {
+    uint32_t request = mIntRequest.load() & ((1 << (mPortE4 & 0x03)) - 1);
+    if (request == 0) return;
+
+    int level = __builtin_ctz(request);
+    mIntRequest.fetch_and(~(1 << level));
+    mClock += mPD780C->IRQ(level << 1);
+}
+
+void PC88VM::initScheduler(void) {
+    mClock = 0;
+    mFrames = 0;
+    mScheduler.reset(mClock);
+    mScheduler.schedule(SCHED_VRTC_START, FRAME_CYCLES - VRTC_CYCLES);
+    mScheduler.schedule(SCHED_VRTC_END, FRAME_CYCLES);
+    mScheduler.schedule(SCHED_CLOCK, CLOCK_CYCLES);
+    mScheduler.schedule(SCHED_CMT, CMT_CYCLES);
+    mFrameDeadline = micros();
+}
+
+void IRAM_ATTR PC88VM::dispatchEvents(void) {
+    int event;
+    while ((event = mScheduler.pop(mClock)) >= 0) {
+        auto time = mScheduler.time(event);
+        switch (event) {
+            case SCHED_VRTC_START:
+                mPD3301->vrtc(true);
+                mPD3301->updateVRAMcahce();
+                mFrames++;
+                if (mDumpFrame && mFrames == mDumpFrame) {
+                    mFrameDumpResult = mPD3301->dumpFrame(mDumpFileName);
+                    mDumpFrame = 0;
+                    mFrameDumped = true;
                 }
-                intCount = 0;
-            }
-            diff = 0;
+                if (mIntVRTC) {
+                    requestInterrupt(INT_VTRC);
+                }
+                mScheduler.schedule(SCHED_VRTC_START, time + FRAME_CYCLES);
+                mPCG8800->render(mClock);
+                throttle();
+                break;
+            case SCHED_VRTC_END:
+                mPD3301->vrtc(false);
+                mScheduler.schedule(SCHED_VRTC_END, time + FRAME_CYCLES);
+                break;
+            case SCHED_CLOCK:
+                if (mIntClock) {
+                    requestInterrupt(INT_CLOCK);
+                }
+                mScheduler.schedule(SCHED_CLOCK, time + CLOCK_CYCLES);
+                break;
+            case SCHED_CMT:
+                mDR320->interrupt();
+                mScheduler.schedule(SCHED_CMT, time + CMT_CYCLES);
+                break;
         }
+    }
+}
 
-        if (vm->mPD780C->getIFF1()) {
-            cpu_cmd_t msg;
-            if (xQueueReceive(vm->mXQueue, &msg, 0)) {
-                int intLevel = vm->mPortE4 & 0x03;
-                switch (msg.cmd) {
-                    case INT_RXRDY:
-                        if (intLevel > 0) {
-                            vm->mPD780C->IRQ(INT_RXRDY);
-                        } else {
-                            xQueueSend(vm->mXQueue, &msg, 0);
-                        }
-                        break;
-                    case INT_VTRC:
-                        if (intLevel > 1) {
-                            vm->mPD780C->IRQ(INT_VTRC);
-                        } else {
-                            xQueueSend(vm->mXQueue, &msg, 0);
-                        }
-                        break;
-                    case INT_CLOCK:
-                        if (intLevel > 2) {
-                            vm->mPD780C->IRQ(INT_CLOCK);
-                        } else {
-                            xQueueSend(vm->mXQueue, &msg, 0);
-                        }
-                        break;
-                }
-            }
+void PC88VM::setFrameDump(uint32_t frame, const char *fileName) {
+    strncpy(mDumpFileName, fileName, sizeof(mDumpFileName) - 1);
+    mDumpFileName[sizeof(mDumpFileName) - 1] = '\0';
+    mFrameDumped = false;
+    mDumpFrame = frame;
+}
+
+// Snapshot configuration word, a snapshot is only loaded into the same machine configuration
+#define SNAPSHOT_CONFIG_400LINE 0x01
+#define SNAPSHOT_CONFIG_EXTRAM 0x02
+#define SNAPSHOT_CONFIG_SUBCPU 0x04
+
+int PC88VM::saveSnapshot(const char *fileName) {
+    auto fp = fopen(fileName, "wb");
+    if (!fp) return -1;
+
+    if (mDiskROM) mPC80S31->pause(true);
+
+    fwrite(SNAPSHOT_ID, 1, 8, fp);
+    uint32_t header[2] = {SNAPSHOT_VERSION, 0};
+    if (mHighResolution) header[1] |= SNAPSHOT_CONFIG_400LINE;
+    if (mExtRAM) header[1] |= SNAPSHOT_CONFIG_EXTRAM;
+    if (mDiskROM) header[1] |= SNAPSHOT_CONFIG_SUBCPU;
+    fwrite(header, sizeof(header), 1, fp);
+
+    snapshot(fp, true);
+
+    if (mDiskROM) mPC80S31->pause(false);
+
+    auto error = ferror(fp);
+    fclose(fp);
+
+#ifdef DEBUG_PC88VM
+    Serial.printf("snapshot saved: %s %d\n", fileName, error);
+#endif
+
+    return error ? -2 : 0;
+}
+
+int PC88VM::loadSnapshot(const char *fileName) {
+    auto fp = fopen(fileName, "rb");
+    if (!fp) return -1;
+
+    char id[8];
+    uint32_t header[2];
+    if (fread(id, 1, 8, fp) != 8 || memcmp(id, SNAPSHOT_ID, 8) || fread(header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        return -2;
+    }
+
+    uint32_t config = 0;
+    if (mHighResolution) config |= SNAPSHOT_CONFIG_400LINE;
+    if (mExtRAM) config |= SNAPSHOT_CONFIG_EXTRAM;
+    if (mDiskROM) config |= SNAPSHOT_CONFIG_SUBCPU;
+    if (header[0] != SNAPSHOT_VERSION || header[1] != config) {
+        fclose(fp);
+        return -3;
+    }
+
+    if (mDiskROM) mPC80S31->pause(true);
+
+    snapshot(fp, false);
+    auto error = ferror(fp) || feof(fp);
+    fclose(fp);
+
+    if (error) {
+        // The state is partially overwritten
+        reset();
+        mPD780C->reset();
+        mPD780C->setPC(0);
+        initScheduler();
+    } else {
+        mRAM0000 = mTextRAM0000;
+        switch (mMemMode) {
+            case 0:  // N80
+                m0000Bank = mN80ROM;
+                break;
+            case 1:  // N88
+                m0000Bank = mN88ROM;
+                break;
+            default:  // RAM
+                m0000Bank = mTextRAM0000;
+                break;
         }
+        setExtRam();
+        setVRAM(mPD3301->getVRAM());
+        rebuildGvramCache();
+        mFrameDeadline = micros();
+    }
+
+    if (mDiskROM) mPC80S31->pause(false);
+
+#ifdef DEBUG_PC88VM
+    Serial.printf("snapshot loaded: %s %d\n", fileName, error);
+#endif
+
+    return error ? -4 : 0;
+}
+
+void PC88VM::snapshot(FILE *fp, bool save) {
+    SNAPSHOT::z80(fp, save, mPD780C);
+    setCpuCallbacks();
+
+    SNAPSHOT_IO(fp, save, mDipSW1);
+    SNAPSHOT_IO(fp, save, mPort30);
+    SNAPSHOT_IO(fp, save, mDipSW2);
+    SNAPSHOT_IO(fp, save, mPort31);
+    SNAPSHOT_IO(fp, save, mMemMode);
+    SNAPSHOT_IO(fp, save, mPort40In);
+    SNAPSHOT_IO(fp, save, mPort40Out);
+    SNAPSHOT_IO(fp, save, mVRTC);
+    SNAPSHOT_IO(fp, save, mPort53);
+    SNAPSHOT_IO(fp, save, mGBank);
+    SNAPSHOT_IO(fp, save, mPort70);
+    SNAPSHOT_IO(fp, save, mExtROM);
+    SNAPSHOT_IO(fp, save, mPortE2);
+    SNAPSHOT_IO(fp, save, mPortE3);
+    SNAPSHOT_IO(fp, save, mPortE4);
+    SNAPSHOT_IO(fp, save, mIntFlag);
+    SNAPSHOT_IO(fp, save, mPortFF);
+    SNAPSHOT_IO(fp, save, mIntClock);
+    SNAPSHOT_IO(fp, save, mIntVRTC);
+    SNAPSHOT_IO(fp, save, mKanjiROMAddr);
+    SNAPSHOT_IO(fp, save, mColumn80);
+    SNAPSHOT_IO(fp, save, mLine25);
+
+    uint32_t intRequest = mIntRequest.load();
+    SNAPSHOT_IO(fp, save, intRequest);
+    if (!save) mIntRequest.store(intRequest);
+
+    SNAPSHOT_IO(fp, save, mClock);
+    SNAPSHOT_IO(fp, save, mFrames);
+    SNAPSHOT_IO(fp, save, mScheduler);
+
+    SNAPSHOT_BLOCK(fp, save, mTextRAM0000, 0x10000);
+    SNAPSHOT_BLOCK(fp, save, mGVRAM0, 0xc000);
+    if (mExtRAM) SNAPSHOT_BLOCK(fp, save, mExtRAM, 1024 * 128);
+
+    mPD3301->snapshot(fp, save);
+    mPCG8800->snapshot(fp, save);
+    mI8255->snapshot(fp, save);
+    mPD8257->snapshot(fp, save);
+    mPD1990->snapshot(fp, save);
+    mDR320->snapshot(fp, save);
+    if (mDiskROM) mPC80S31->snapshot(fp, save);
+}
+
+// GVRAM caches of the renderer from the GVRAM planes
+void PC88VM::rebuildGvramCache(void) {
+    auto cache = (uint32_t *)mGvramCache200;
+    for (int address = 0; address < 0x4000; address++) {
+        cache[address] = *(mBankBit + GBANK0_BLUE * 256 + mGVRAM0[address]) | *(mBankBit + GBANK1_RED * 256 + mGVRAM1[address]) |
+                         *(mBankBit + GBANK2_GREEN * 256 + mGVRAM2[address]);
+    }
+
+    memcpy(mGvramCache400, mGVRAM0, 80 * 200);
+    memcpy(mGvramCache400 + 80 * 200, mGVRAM1, 80 * 200);
+}
+
+// Wall clock pacing, once per emulated frame
+void PC88VM::throttle(void) {
+    if (mNoWait) {
+        mFrameDeadline = micros();
+        return;
+    }
+
+    mFrameDeadline += FRAME_TIME * CPU_SPEED_NORMAL_WAIT / mWait;
+
+    int32_t wait = mFrameDeadline - micros();
+    if (wait > 0) {
+        delayMicroseconds(wait);
+    } else if (wait < -FRAME_TIME * 2) {
+        mFrameDeadline = micros();  // too late to catch up
     }
 }
 
@@ -365,55 +700,112 @@ void PC88VM::setExtRam(void) {
         }
         mRAM0000 = mTextRAM0000;
     }
+
+    updateMemoryMap0000();
+    updateMemoryMapWindow();
+}
+
+void PC88VM::updateMemoryMap(void) {
+    updateMemoryMap0000();
+    for (int page = 0x83; page < 0xc0; page++) {
+        mapPage(page, page << 8);
+    }
+    updateMemoryMapC000();
+}
+
+// 0x0000 - 0x7fff
+void PC88VM::updateMemoryMap0000(void) {
+    for (int page = 0x00; page < 0x80; page++) {
+        int address = page << 8;
+        if (mExtROM == 0xff) {
+            mReadMap[page] = m0000Bank + address;
+        } else if (address < 0x6000) {
+            mReadMap[page] = mN88ROM + address;
+        } else if ((mExtROM & 0x01) == 0) {  // 0xFE
+            mReadMap[page] = m4thROM + address - 0x6000;
+        } else if ((mExtROM & 0x02) == 0) {  // 0xFD
+            mReadMap[page] = mUserROM + address - 0x6000;
+        } else {
+            mReadMap[page] = mZeroPage;
+        }
+        mWriteMap[page] = writePage(mRAM0000 + address);
+    }
+}
+
+// 0xc000 - 0xffff
+void PC88VM::updateMemoryMapC000(void) {
+    for (int page = 0xc0; page < 0x100; page++) {
+        mapPage(page, page << 8);
+    }
+    updateMemoryMapWindow();
+}
+
+// Window 0x8000 - 0x82ff
+void PC88VM::updateMemoryMapWindow(void) {
+    for (int i = 0; i < 3; i++) {
+        mapPage(0x80 + i, ((mPort70 + i) << 8) & 0xffff);
+    }
+}
+
+void PC88VM::mapPage(int page, int address) {
+    if (address < 0x8000) {
+        mReadMap[page] = mRAM0000 + address;
+        mWriteMap[page] = writePage(mReadMap[page]);
+    } else if (address < 0xc000) {
+        mReadMap[page] = mRAM8000 + address - 0x8000;
+        mWriteMap[page] = writePage(mReadMap[page]);
+    } else {
+        mReadMap[page] = mGBankMem[mGBank] + address - 0xc000;
+        mWriteMap[page] = (mGBank == GBANK_MAIN) ? writePage(mReadMap[page]) : nullptr;
+    }
+}
+
+// Pages overlapping the text VRAM are written through writeRAM
+uint8_t *PC88VM::writePage(uint8_t *p) {
+    if (p < mTextVRAM + TEXT_VRAM_SIZE && p + 0x100 > mTextVRAM) return nullptr;
+    return p;
+}
+
+// 0x0000 - 0xffff address of a guest address that has no write page
+int IRAM_ATTR PC88VM::linearAddress(int address) {
+    if (0x8000 <= address && address < 0x8300) {
+        address = ((mPort70 << 8) + address - 0x8000) & 0xffff;
+    }
+    return address;
+}
+
+void IRAM_ATTR PC88VM::writeRAM(int address, uint8_t value) {
+    auto p = (address < 0x8000 ? mRAM0000 : mTextRAM0000) + address;
+    *p = value;
+
+    int offset = p - mTextVRAM;
+    if (0 <= offset && offset < TEXT_VRAM_SIZE) {
+        mPD3301->textWrite(offset);
+    }
+}
+
+void PC88VM::setVRAM(int vram) {
+    mPD3301->setVRAM(vram);
+    mTextVRAM = mTextRAM0000 + vram;
+    updateMemoryMap();
 }
 
-int IRAM_ATTR PC88VM::readWord(void *context, int addr) { return readByte(context, addr) | (readByte(context, addr + 1) << 8); }
+int IRAM_ATTR PC88VM::readWord(void *context, int addr) { return readByte(context, addr) | (readByte(context, (addr + 1) & 0xffff) << 8); }
 
 void IRAM_ATTR PC88VM::writeWord200(void *context, int addr, int value) {
     writeByte200(context, addr, value & 0xFF);
-    writeByte200(context, addr + 1, value >> 8);
+    writeByte200(context, (addr + 1) & 0xffff, value >> 8);
 }
 
 void IRAM_ATTR PC88VM::writeWord400(void *context, int addr, int value) {
     writeByte400(context, addr, value & 0xFF);
-    writeByte400(context, addr + 1, value >> 8);
+    writeByte400(context, (addr + 1) & 0xffff, value >> 8);
 }
 
 int IRAM_ATTR PC88VM::readByte(void *context, int address) {
     auto vm = (PC88VM *)context;
 
-    int value;
-
-    if (address < 0x8000) {
-        if (vm->mExtROM == 0xff) {
-            value = vm->m0000Bank[address];
-        } else if (address < 0x6000) {
-            value = vm->mN88ROM[address];
-        } else {
-            if ((vm->mExtROM & 0x01) == 0) {  // 0xFE
-                value = vm->m4thROM[address - 0x6000];
-            } else if ((vm->mExtROM & 0x02) == 0) {  // 0xFD
-                value = vm->mUserROM[address - 0x6000];
-            } else {
-                value = 0;
-            }
-        }
-    } else {
-        // 0x8000 - 0xFFFF
-        if (address < 0x8300) {  // Window 0x8000 - 0x82ff
-            address = (vm->mPort70 << 8) + address - 0x8000;
-        }
-
-        if (address < 0x8000) {
-            value = vm->mRAM0000[address];
-        } else if (address < 0xc000) {
-            value = vm->mRAM8000[address - 0x8000];
-        } else {
-            value = vm->mGBankMem[vm->mGBank][address - 0xc000];
-        }
-    }
-
-    return value;
+    return vm->mReadMap[address >> 8][address & 0xff];
 }
 
 void IRAM_ATTR PC88VM::writeByte200(void *context, int address, int value) {
@@ -421,29 +813,26 @@ void IRAM_ATTR PC88VM::writeByte200(void *context, int address, int value) {
 
     auto vm = (PC88VM *)context;
 
-    value &= 0xff;
+    auto page = vm->mWriteMap[address >> 8];
+    if (page) {
+        page[address & 0xff] = value;
+        return;
+    }
 
-    if (address < 0x8000) {
-        vm->mRAM0000[address] = value;
-    } else {
-        if (address < 0x8300) {
-            address = (vm->mPort70 << 8) + address - 0x8000;
-        }
+    address = vm->linearAddress(address);
+    if (address < 0xc000 || vm->mGBank == GBANK_MAIN) {
+        vm->writeRAM(address, value);
+        return;
+    }
 
-        if (address < 0x8000) {
-            vm->mRAM0000[address] = value;
-        } else if (address < 0xc000) {
-            vm->mRAM8000[address - 0x8000] = value & 0xff;
-        } else {
-            address -= 0x0c000;
-            auto gBank = vm->mGBank;
-            vm->mGBankMem[gBank][address] = value;
-            if (gBank == GBANK_MAIN) return;
+    // GVRAM
+    value &= 0xff;
+    address -= 0xc000;
+    auto gBank = vm->mGBank;
+    vm->mGBankMem[gBank][address] = value;
 
-            *((uint32_t *)&vm->mGvramCache200[address * 4]) &= bankMask[gBank];
-            *((uint32_t *)&vm->mGvramCache200[address * 4]) |= *(vm->mBankBit + gBank * 256 + value);
-        }
-    }
+    *((uint32_t *)&vm->mGvramCache200[address * 4]) &= bankMask[gBank];
+    *((uint32_t *)&vm->mGvramCache200[address * 4]) |= *(vm->mBankBit + gBank * 256 + value);
 }
 
 void IRAM_ATTR PC88VM::writeByte400(void *context, int address, int value) {
@@ -451,39 +840,36 @@ void IRAM_ATTR PC88VM::writeByte400(void *context, int address, int value) {
 
     auto vm = (PC88VM *)context;
 
-    value &= 0xff;
+    auto page = vm->mWriteMap[address >> 8];
+    if (page) {
+        page[address & 0xff] = value;
+        return;
+    }
 
-    if (address < 0x8000) {
-        vm->mRAM0000[address] = value;
-    } else {
-        if (address < 0x8300) {
-            address = (vm->mPort70 << 8) + address - 0x8000;
-        }
+    address = vm->linearAddress(address);
+    if (address < 0xc000 || vm->mGBank == GBANK_MAIN) {
+        vm->writeRAM(address, value);
+        return;
+    }
 
-        if (address < 0x8000) {
-            vm->mRAM0000[address] = value;
-        } else if (address < 0xc000) {
-            vm->mRAM8000[address - 0x8000] = value & 0xff;
-        } else {
-            address -= 0x0c000;
-            auto gBank = vm->mGBank;
-            vm->mGBankMem[gBank][address] = value;
-            if (gBank == GBANK_MAIN) return;
-
-            *((uint32_t *)&vm->mGvramCache200[address * 4]) &= bankMask[gBank];
-            *((uint32_t *)&vm->mGvramCache200[address * 4]) |= *(vm->mBankBit + gBank * 256 + value);
-
-            address &= 0xfffc;
-            if (address < 80 * 200) {
-                switch (gBank) {
-                    case GBANK0_BLUE:
-                        *((uint32_t *)&vm->mGvramCache400[address]) = *((uint32_t *)&vm->mGBankMem[gBank][address]);
-                        break;
-                    case GBANK1_RED:
-                        *((uint32_t *)&vm->mGvramCache400[address + 80 * 200]) = *((uint32_t *)&vm->mGBankMem[gBank][address]);
-                        break;
-                }
-            }
+    // GVRAM
+    value &= 0xff;
+    address -= 0xc000;
+    auto gBank = vm->mGBank;
+    vm->mGBankMem[gBank][address] = value;
+
+    *((uint32_t *)&vm->mGvramCache200[address * 4]) &= bankMask[gBank];
+    *((uint32_t *)&vm->mGvramCache200[address * 4]) |= *(vm->mBankBit + gBank * 256 + value);
+
+    address &= 0xfffc;
+    if (address < 80 * 200) {
+        switch (gBank) {
+            case GBANK0_BLUE:
+                *((uint32_t *)&vm->mGvramCache400[address]) = *((uint32_t *)&vm->mGBankMem[gBank][address]);
+                break;
+            case GBANK1_RED:
+                *((uint32_t *)&vm->mGvramCache400[address + 80 * 200]) = *((uint32_t *)&vm->mGBankMem[gBank][address]);
+                break;
         }
     }
 }
@@ -526,7 +912,7 @@ int PC88VM::readIO(void *context, int address) {
         case 0x31:
             return vm->mDipSW2;
         case 0x40:
-            // VRTC is updated in PD3301::drawScanline.
+            // VRTC is updated by PD3301::vrtc.
             vm->mPort40In = (vm->mPort40In & 0xef) | vm->mPD1990->read();  // PD1990 calender clock
             return vm->mPort40In;
         case 0x50:
@@ -595,19 +981,21 @@ void PC88VM::writeIO(void *context, int address, int value) {
             vm->mPCG8800->port01(value);
             break;
         case 0x02:
-            vm->mPCG8800->port02(value);
+            vm->mPCG8800->port02(value, vm->mClock);
+            vm->mPD3301->invalidateText();  // font may be rewritten
             break;
         case 0x03:
             vm->mPCG8800->port03(value);
+            vm->mPD3301->invalidateText();
             break;
         case 0x0c:
-            vm->mPCG8800->port0c(value);
+            vm->mPCG8800->port0c(value, vm->mClock);
             break;
         case 0x0d:
-            vm->mPCG8800->port0d(value);
+            vm->mPCG8800->port0d(value, vm->mClock);
             break;
         case 0x0e:
-            vm->mPCG8800->port0e(value);
+            vm->mPCG8800->port0e(value, vm->mClock);
             break;
         case 0x0f:
             vm->mPCG8800->port0f(value);
@@ -641,10 +1029,11 @@ void PC88VM::writeIO(void *context, int address, int value) {
                     vm->m0000Bank = vm->mRAM0000;
                     break;
             }
+            vm->updateMemoryMap0000();
             vm->mPD3301->displayMode(value, !(vm->mPort40In & 0x02));
             break;
         case 0x40:
-            vm->mPCG8800->beep(value & 0x20);
+            vm->mPCG8800->port40(value, vm->mClock);
             vm->mPD1990->write(0x40, value);
             vm->mPort40Out = value;
             break;
@@ -686,15 +1075,19 @@ void PC88VM::writeIO(void *context, int address, int value) {
             break;
         case 0x5c:
             vm->mGBank = GBANK0_BLUE;
+            vm->updateMemoryMapC000();
             break;
         case 0x5d:
             vm->mGBank = GBANK1_RED;
+            vm->updateMemoryMapC000();
             break;
         case 0x5e:
             vm->mGBank = GBANK2_GREEN;
+            vm->updateMemoryMapC000();
             break;
         case 0x5f:
             vm->mGBank = GBANK_MAIN;
+            vm->updateMemoryMapC000();
             break;
         case 0x60:
             vm->mPD8257->dmaAddress(0, value);
@@ -725,12 +1118,15 @@ void PC88VM::writeIO(void *context, int address, int value) {
             break;
         case 0x70:
             vm->mPort70 = value & 0xff;
+            vm->updateMemoryMapWindow();
             break;
         case 0x71:
             vm->mExtROM = value & 0xff;
+            vm->updateMemoryMap0000();
             break;
         case 0x78:
             vm->mPort70++;
+            vm->updateMemoryMapWindow();
             break;
         case 0xc0:  // 8251 RS-232C channel 1 Data
             break;
@@ -792,12 +1188,37 @@ void PC88VM::writeIO(void *context, int address, int value) {
     }
 }
 
+// Call code as a subroutine at the instruction where the main CPU stopped, a RET of the code goes back there.
+// A halted CPU is woken up and returns to the HALT, the interrupt state is kept. The code must be in the RAM mapped now.
+void PC88VM::callCode(int address) {
+    address &= 0xffff;
+    if (mReadMap[address >> 8] != mTextRAM0000 + (address & 0xff00)) return;
+
+    z80_regs_t regs;
+    SNAPSHOT::getZ80(mPD780C, &regs);
+    auto pc = regs.halt ? (regs.pc - 1) & 0xffff : regs.pc;
+    regs.halt = false;
+    regs.word[fabgl::Z80_SP] = (regs.word[fabgl::Z80_SP] - 2) & 0xffff;
+    regs.pc = address;
+
+    mPD780C->reset();
+    SNAPSHOT::setZ80(mPD780C, &regs);
+    setCpuCallbacks();
+
+    if (mHighResolution) {
+        writeWord400(this, regs.word[fabgl::Z80_SP], pc);
+    } else {
+        writeWord200(this, regs.word[fabgl::Z80_SP], pc);
+    }
+}
+
 void PC88VM::vmControl(PC88VM *vm) {
     auto cmd = vm->mKbCmd;
 
     if (cmd == CMD_PC88MENU) {
         vm->suspend(true);
         cmd = vm->mPC88MENU->menu(vm);
+        vm->mPD3301->invalidateVRAM();  // RAM may be loaded by the menu
         vm->suspend(false);
         if (cmd == -1) return;
     }
@@ -808,6 +1229,9 @@ void PC88VM::vmControl(PC88VM *vm) {
             vm->mPD780C->setPC(0xff3d);
             vm->mPD780C->writeRegWord(Z80_SP, *(uint16_t *)&vm->mRAM0000[0xff3e]);
             break;
+        case CMD_CMT_FILE:  // machine code of a cmt file
+            vm->callCode(vm->mStartAddress);
+            break;
         case CMD_RESET:
             vm->reset();
             vm->mPD780C->reset();
@@ -823,6 +1247,7 @@ void PC88VM::vmControl(PC88VM *vm) {
             break;
         case CMD_PCG_ON_OFF:
             vm->mPCG8800->pcg();
+            vm->mPD3301->invalidateText();
             break;
         case CMD_TAPE_REWIND:
             vm->mDR320->rewind();
@@ -865,11 +1290,11 @@ int PC88VM::initFileSystem(void) {
         return -1;
     }
 
-    const char *dirName[3] = {PC88DIR_DISK, PC88DIR_TAPE, PC88DIR_N80};
+    const char *dirName[4] = {PC88DIR_DISK, PC88DIR_TAPE, PC88DIR_N80, PC88DIR_SNAPSHOT};
 
     FileBrowser dir(mRootDir);
 
-    for (int i = 0; i < 3; i++) {
+    for (int i = 0; i < 4; i++) {
         char name[32];
         strcpy(&name[0], dirName[i]);
         if (!dir.exists(&name[1])) {
@@ -890,6 +1315,8 @@ int PC88VM::initMemory(void) {
     mRAM8000 = mRAM0000 + 0x8000;
     mRAMC000 = mRAM0000 + 0xc000;
 
+    mTextVRAM = mTextRAM0000 + mPD3301->getVRAM();
+
     for (int i = 0; i < 0x10000; i += 4) *(uint32_t *)(mRAM0000 + i) = 0xff00ff00;
 
     mGVRAM0 = lalloc(0xc000);
@@ -918,6 +1345,8 @@ int PC88VM::initMemory(void) {
 
     mExtRAM = nullptr;
 
+    mZeroPage = lalloc(0x100, true);
+
     mUserROM = lalloc(0x2000, false, "USER.ROM", false);
     if (mUserROM == nullptr) {
         mUserROM = lalloc(0x2000);
@@ -1139,7 +1568,7 @@ void PC88VM::setCpuSpeed(int speed) {
             mWait = 7;
             break;
         case CPU_SPEED_NORMAL:
-            mWait = 6;
+            mWait = CPU_SPEED_NORMAL_WAIT;
             break;
         case CPU_SPEED_A_LITTLE_SLOW:
             mWait = 5;
@@ -1154,7 +1583,7 @@ void PC88VM::setCpuSpeed(int speed) {
             mWait = 2;
             break;
         default:
-            mWait = 6;
+            mWait = CPU_SPEED_NORMAL_WAIT;
             break;
     }
 }
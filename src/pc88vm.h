@@ -26,6 +26,8 @@
 
 #include <sys/stat.h>
 
+#include <atomic>
+
 #include "dr320.h"
 #include "emudevs/Z80.h"
 #include "fabgl.h"
@@ -34,17 +36,21 @@
 #include "pc80s31.h"
 #include "pc88keyboard.h"
 #include "pc88menu.h"
+#include "pc88scheduler.h"
 #include "pc88settings.h"
 #include "pcg8800.h"
 #include "pd1990.h"
 #include "pd3301.h"
 #include "pd8257.h"
 
+#ifndef SD_MOUNT_POINT
 #define SD_MOUNT_POINT "/SD"
+#endif
 #define PC88DIR "/pc8801"
 #define PC88DIR_DISK "/disk"
 #define PC88DIR_TAPE "/tape"
 #define PC88DIR_N80 "/n80"
+#define PC88DIR_SNAPSHOT "/snapshot"
 
 #define CPU_CMD_DEBUG 1
 
@@ -52,6 +58,9 @@
 #define INT_VTRC 0x02
 #define INT_CLOCK 0x04
 
+// Pending bit of an interrupt vector, a lower bit has a higher priority
+#define INT_REQUEST(vector) (1 << ((vector) >> 1))
+
 #define CMD_PC88MENU (0x1000)
 #define CMD_HOT_START (0x1001)
 #define CMD_RESET (0x1002)
@@ -65,6 +74,7 @@
 #define CMD_VOLUME_DOWN (0x100a)
 #define CMD_N80_FILE (0x100b)
 #define CMD_BASIC_ON_RAM (0x100c)
+#define CMD_CMT_FILE (0x100d)
 
 // CMD 0x2000 - 0x2006
 #define CMD_CPU_SPEED (0x2000)
@@ -79,16 +89,22 @@
 #define CPU_SPEED_VERY_SLOW (8)
 #define CPU_SPEED_VERY_VERY_SLOW (9)
 
-typedef struct {
-    int cmd;
-    int data;
-} cpu_cmd_t;
+#define CPU_SPEED_NORMAL_WAIT (6)
 
 typedef struct {
     int cmd;
     char param[32];
 } debug_cmd_t;
 
+#define KEY_EVENTS_MAX 1024
+
+// Scripted key event of the headless mode
+typedef struct {
+    uint32_t frame;
+    bool keyUp;
+    int scanCode;
+} key_event_t;
+
 class PC88MENU;
 class DR320;
 
@@ -99,6 +115,8 @@ class PC88VM {
 
     void run(void);
     void subTask(void);
+    int runHeadless(uint64_t cycles, uint32_t frames, const char *scriptFileName, const char *loadFileName = nullptr,
+                    const char *saveFileName = nullptr);
 
     static int readByte(void *context, int address);
     static void writeByte200(void *context, int address, int value);
@@ -114,7 +132,10 @@ class PC88VM {
     volatile bool mSuspending;
 
     QueueHandle_t mXQueueDebug;
-    QueueHandle_t mXQueue;
+
+    // Interrupt requests from the timers and DR320
+    std::atomic<uint32_t> mIntRequest;
+    void requestInterrupt(int vector) { mIntRequest.fetch_or(INT_REQUEST(vector)); }
 
     bool mColumn80 = false;
     bool mLine25 = true;
@@ -133,9 +154,21 @@ class PC88VM {
     pc88_settings_t *getCurrentSettings(void) { return mSettings; }
     PC88SETTINGS *getPC88Settings(void) { return mPC88Settings; }
     uint8_t *getRAM8000(void) { return mRAM8000; }
+    uint8_t *getRAM(void) { return mTextRAM0000; }
+    void setStartAddress(int address) { mStartAddress = address; }
     static void setPCG(bool value, void *context);
     void setVolume(int value);
     void setCpuSpeed(int speed);
+    void setVRAM(int vram);
+
+    // Dump the screen as a PPM file after the given number of emulated frames
+    void setFrameDump(uint32_t frame, const char *fileName);
+    volatile bool mFrameDumped;
+    int mFrameDumpResult;
+
+    // Machine state, the main CPU must be stopped (menu or headless loop)
+    int saveSnapshot(const char *fileName);
+    int loadSnapshot(const char *fileName);
 
    private:
     bool mTrace;
@@ -170,6 +203,12 @@ class PC88VM {
     uint8_t *mExtRAM;  // PC-8801-02N
     int mKanjiROMAddr;
 
+    // Memory map: 256 pages of 256 bytes, nullptr in mWriteMap means GVRAM or text VRAM
+    uint8_t *mReadMap[256];
+    uint8_t *mWriteMap[256];
+    uint8_t *mZeroPage;
+    uint8_t *mTextVRAM;
+
     PC88SETTINGS *mPC88Settings;
     pc88_settings_t *mSettings;
 
@@ -178,6 +217,20 @@ class PC88VM {
     fabgl::Z80 *mPD780C;
     static void pc88Task(void *pvParameters);
 
+    // Emulated time in T-states
+    PC88SCHEDULER mScheduler;
+    uint32_t mClock;
+    uint32_t mFrameDeadline;
+    uint32_t mFrames;
+
+    uint32_t mDumpFrame;
+    char mDumpFileName[256];
+
+    void initScheduler(void);
+    void dispatchEvents(void);
+    void acceptInterrupt(void);
+    void throttle(void);
+
     // Port 30h
     uint8_t mDipSW1;
     uint8_t mPort30;
@@ -229,11 +282,13 @@ class PC88VM {
     char mFileName[64];
 
     int mKbCmd;
+    int mStartAddress;
 
     volatile int mWait;
     volatile bool mNoWait;
 
     void memDump(uint8_t *mRAM, int address, int offset);
+    int loadKeyScript(const char *fileName, key_event_t *events);
 
     int init(void);
     int initFileSystem(void);
@@ -247,6 +302,9 @@ class PC88VM {
     int getAddress(char *p);
 
     void coldBoot(void);
+    void setCpuCallbacks(void);
+    void snapshot(FILE *fp, bool save);
+    void rebuildGvramCache(void);
     void reset(void);
     void dumpReg(fabgl::Z80_STATE *state);
 
@@ -257,6 +315,16 @@ class PC88VM {
 
     void setExtRam(void);
 
+    void updateMemoryMap(void);
+    void updateMemoryMap0000(void);
+    void updateMemoryMapC000(void);
+    void updateMemoryMapWindow(void);
+    void mapPage(int page, int address);
+    uint8_t *writePage(uint8_t *p);
+    int linearAddress(int address);
+    void writeRAM(int address, uint8_t value);
+
+    void callCode(int address);
     void vmControl(PC88VM *vm);
 
     static void esp32Restart(PC88VM *vm);
@@ -26,6 +26,8 @@
 
 #include <cstring>
 
+#include "snapshot.h"
+
 #ifdef DEBUG_PC88
 // #define DEBUG_PCG8800
 #endif
@@ -51,6 +53,7 @@ PCG8800::PCG8800() {
     mBit5 = false;
 
     mBeep = false;
+    mSing = false;
 }
 
 PCG8800::~PCG8800() {}
@@ -92,21 +95,16 @@ void PCG8800::init(uint8_t *fontROM, int volume) {
     setVolume(volume);
     mSoundGenerator.play(true);
 
+    // The counters and the beep are rendered by the mixer
+    mSoundGenerator.attach(&mSoundMixer);
+    mSoundMixer.init();
+
     for (int i = 0; i < 3; i++) {
-        mSquareWaveformGenerator[i] = new fabgl::SquareWaveformGenerator();
-        mSoundGenerator.attach(mSquareWaveformGenerator[i]);
-        enable(i, false);
         mCounter[i] = false;
         mStatus[i] = false;
         mI8253Mode[i] = I8253_MODE_COUNTER_LATCH;
         mI8253Counter[i] = 0;
     }
-
-    // Beep
-    mSquareWaveformGenerator[3] = new SquareWaveformGenerator();
-    mSoundGenerator.attach(mSquareWaveformGenerator[3]);
-    mSquareWaveformGenerator[3]->setFrequency(2400);
-    mSquareWaveformGenerator[3]->enable(false);
 }
 
 void PCG8800::initFont(void) {
@@ -117,9 +115,12 @@ void PCG8800::initFont(void) {
 }
 
 void PCG8800::reset(void) {
-    for (int i = 0; i < 4; i++) {
-        mSquareWaveformGenerator[i]->enable(false);
+    for (int i = 0; i < 3; i++) {
+        mStatus[i] = false;
     }
+    mBeep = false;
+    mSing = false;
+    mSoundMixer.reset(0);
     mBeepMute = false;
 }
 
@@ -139,9 +140,9 @@ void PCG8800::volumeUp() { setVolume(mVolumeValue + 1); }
 
 void PCG8800::volumeDown() { setVolume(mVolumeValue - 1); }
 
-void PCG8800::enable(int value, bool status) {
+void PCG8800::enable(int value, bool status, uint32_t clock) {
     mStatus[value] = status;
-    mSquareWaveformGenerator[value]->enable(status);
+    mSoundMixer.enableCounter(value, status, clock);
 }
 
 void PCG8800::soundMute() {
@@ -155,7 +156,7 @@ void PCG8800::soundMute() {
 
 void PCG8800::port00(uint8_t value) { mPCGData = value; }
 void PCG8800::port01(uint8_t value) { mPCGAddr = (mPCGAddr & 0xff00) | value; }
-void PCG8800::port02(uint8_t value) {
+void PCG8800::port02(uint8_t value, uint32_t clock) {
     static uint8_t fontConv[16] = {0x00, 0x03, 0x0c, 0x0f, 0x30, 0x33, 0x3c, 0x3f, 0xc0, 0xc3, 0xcc, 0xcf, 0xf0, 0xf3, 0xfc, 0xff};
 
     mPCGAddr = (mPCGAddr & 0x00ff | (value & 0x07) << 8) ^ 0x400;
@@ -197,7 +198,7 @@ void PCG8800::port02(uint8_t value) {
 
     for (int i = 0; i < 3; i++) {
         if (mCounter[i] != mStatus[i]) {
-            enable(i, mCounter[i]);
+            enable(i, mCounter[i], clock);
         }
     }
 }
@@ -292,11 +293,11 @@ void PCG8800::pcg(void) {
 
 void PCG8800::pcgON(void) { port03(0x08); }
 
-void PCG8800::port0c(uint8_t value) { setCounter(0, value); }
+void PCG8800::port0c(uint8_t value, uint32_t clock) { setCounter(0, value, clock); }
 
-void PCG8800::port0d(uint8_t value) { setCounter(1, value); }
+void PCG8800::port0d(uint8_t value, uint32_t clock) { setCounter(1, value, clock); }
 
-void PCG8800::port0e(uint8_t value) { setCounter(2, value); }
+void PCG8800::port0e(uint8_t value, uint32_t clock) { setCounter(2, value, clock); }
 
 void PCG8800::port0f(uint8_t value) {
     int counter = (value & 0xc0) >> 6;
@@ -320,16 +321,16 @@ void PCG8800::port0f(uint8_t value) {
     }
 }
 
-void PCG8800::setCounter(int counter, int value) {
+void PCG8800::setCounter(int counter, int value, uint32_t clock) {
     value &= 0xff;
     switch (mI8253Mode[counter]) {
         case I8253_MODE_LO_BYTE:
             mI8253Counter[counter] = (mI8253Counter[counter] & 0xff00) | value;
-            setFrequency(counter);
+            mSoundMixer.setCounter(counter, mI8253Counter[counter], clock);
             break;
         case I8253_MODE_HI_BYTE:
             mI8253Counter[counter] = (mI8253Counter[counter] & 0x00ff) | (value << 8);
-            setFrequency(counter);
+            mSoundMixer.setCounter(counter, mI8253Counter[counter], clock);
             break;
         case I8253_MODE_LO_HI_BYTES:
             mI8253Counter[counter] = (mI8253Counter[counter] & 0xff00) | value;
@@ -338,22 +339,11 @@ void PCG8800::setCounter(int counter, int value) {
         case I8253_MODE_LO_HI_BYTES2:
             mI8253Counter[counter] = (mI8253Counter[counter] & 0x00ff) | (value << 8);
             mI8253Mode[counter] = I8253_MODE_LO_HI_BYTES;
-            setFrequency(counter);
+            mSoundMixer.setCounter(counter, mI8253Counter[counter], clock);
             break;
     }
 }
 
-void PCG8800::setFrequency(int counter) {
-    int freq = 0;
-    if (mI8253Counter[counter] > 0) {
-        freq = 4000000 / (int)mI8253Counter[counter];
-    }
-    if (freq > 15000) {
-        freq = 15000;
-    }
-    mSquareWaveformGenerator[counter]->setFrequency(freq);
-}
-
 void PCG8800::suspend(bool value) {
     if (value) {
         mSoundGenerator.play(false);
@@ -362,9 +352,55 @@ void PCG8800::suspend(bool value) {
     }
 }
 
-void PCG8800::beep(bool value) {
-    if (mBeep != value) {
-        mSquareWaveformGenerator[3]->enable(value);
-        mBeep = value;
-    };
-}
\ No newline at end of file
+// Bit 5 gates the 2400Hz beep, bit 7 (SING) drives the speaker directly
+void PCG8800::port40(uint8_t value, uint32_t clock) {
+    bool beep = value & 0x20;
+    bool sing = value & 0x80;
+
+    if (mBeep != beep) {
+        mSoundMixer.beep(beep, clock);
+        mBeep = beep;
+    }
+    if (mSing != sing) {
+        mSoundMixer.sing(sing, clock);
+        mSing = sing;
+    }
+}
+
+// Font RAM of the PCG, the fonts in use (80 and 40 columns) and the 8253 counters
+void PCG8800::snapshot(FILE *fp, bool save) {
+    SNAPSHOT_BLOCK(fp, save, mFont80, (256 * 10 + 256 * 2 * 10) * 3);
+    SNAPSHOT_BLOCK(fp, save, mFontROM80, 0x2800);
+    SNAPSHOT_IO(fp, save, mHighCode);
+    SNAPSHOT_IO(fp, save, mLowCode);
+    SNAPSHOT_IO(fp, save, mHighCodePCG);
+    SNAPSHOT_IO(fp, save, mLowCodePCG);
+    SNAPSHOT_IO(fp, save, mPCGAddr);
+    SNAPSHOT_IO(fp, save, mPCGData);
+    SNAPSHOT_IO(fp, save, mCounter);
+    SNAPSHOT_IO(fp, save, mBit4);
+    SNAPSHOT_IO(fp, save, mBit5);
+    SNAPSHOT_IO(fp, save, mBeep);
+    SNAPSHOT_IO(fp, save, mPort03);
+    SNAPSHOT_IO(fp, save, mStatus);
+    SNAPSHOT_IO(fp, save, mI8253Mode);
+    SNAPSHOT_IO(fp, save, mI8253Counter);
+
+    if (save) return;
+
+    mFontROM80PCG = mPort03 & 0x10 ? mFont80PCG1 : mFont80PCG0;
+    mFontROM40PCG = mPort03 & 0x10 ? mFont40PCG1 : mFont40PCG0;
+    mFont80PCGHigh = mPort03 & 0x04 ? mFont80PCG1 : mFont80PCG0;
+    mFont40PCGHigh = mPort03 & 0x04 ? mFont40PCG1 : mFont40PCG0;
+    mFont80PCGLow = mPort03 & 0x01 ? mFont80PCG1 : mFont80PCG0;
+    mFont40PCGLow = mPort03 & 0x01 ? mFont40PCG1 : mFont40PCG0;
+
+    // The mixer restarts from the restored state at the next frame
+    mSing = false;
+    mSoundMixer.reset(0);
+    for (int i = 0; i < 3; i++) {
+        mSoundMixer.setCounter(i, mI8253Counter[i], 0);
+        mSoundMixer.enableCounter(i, mStatus[i], 0);
+    }
+    mSoundMixer.beep(mBeep, 0);
+}
@@ -25,8 +25,10 @@
 #pragma GCC optimize("O2")
 
 #include <cstdint>
+#include <cstdio>
 
 #include "fabgl.h"
+#include "sound-mixer.h"
 
 class PCG8800 {
    public:
@@ -39,15 +41,16 @@ class PCG8800 {
 
     void port00(uint8_t value);
     void port01(uint8_t value);
-    void port02(uint8_t value);
+    void port02(uint8_t value, uint32_t clock);
     void port03(uint8_t value);
-    void port0c(uint8_t value);
-    void port0d(uint8_t value);
-    void port0e(uint8_t value);
+    void port0c(uint8_t value, uint32_t clock);
+    void port0d(uint8_t value, uint32_t clock);
+    void port0e(uint8_t value, uint32_t clock);
     void port0f(uint8_t value);
 
     void suspend(bool value);
-    void beep(bool value);
+    void port40(uint8_t value, uint32_t clock);
+    void render(uint32_t clock) { mSoundMixer.render(clock); }
     void pcg(void);
     void pcgON(void);
 
@@ -57,6 +60,8 @@ class PCG8800 {
     void volumeUp(void);
     void volumeDown(void);
 
+    void snapshot(FILE *fp, bool save);
+
    private:
     uint8_t *mFontROM80;
     uint8_t *mFontROM40;
@@ -94,11 +99,12 @@ class PCG8800 {
     bool mBit5;
 
     bool mBeep;
+    bool mSing;
 
     uint8_t mPort03;
 
     fabgl::SoundGenerator mSoundGenerator;
-    fabgl::WaveformGenerator *mSquareWaveformGenerator[4];
+    SoundMixer mSoundMixer;
     bool mStatus[3];
     uint8_t mI8253Mode[3];
     uint16_t mI8253Counter[3];
@@ -107,7 +113,6 @@ class PCG8800 {
 
     static const uint8_t mVolume[16];
     int mVolumeValue;
-    void enable(int value, bool status);
-    void setCounter(int counter, int value);
-    void setFrequency(int counter);
+    void enable(int value, bool status, uint32_t clock);
+    void setCounter(int counter, int value, uint32_t clock);
 };
\ No newline at end of file
@@ -26,6 +26,8 @@
 #include <sys/time.h>
 #include <time.h>
 
+#include "snapshot.h"
+
 #ifdef DEBUG_PC88
 // #define DEBUG_PD1990
 #endif
@@ -145,3 +147,13 @@ void PD1990::setDateTime(void) {
 
 uint8_t PD1990::toBCD(uint8_t value) { return (value / 10) * 16 + (value % 10); }
 uint8_t PD1990::toBin(uint8_t value) { return (value / 16) * 10 + (value % 16); }
+
+void PD1990::snapshot(FILE *fp, bool save) {
+    SNAPSHOT_IO(fp, save, mCmd);
+    SNAPSHOT_IO(fp, save, mDataIn);
+    SNAPSHOT_IO(fp, save, mCSTB);
+    SNAPSHOT_IO(fp, save, mCCK);
+    SNAPSHOT_IO(fp, save, mShift);
+    SNAPSHOT_IO(fp, save, mInData);
+    SNAPSHOT_IO(fp, save, mOutData);
+}
@@ -25,6 +25,7 @@
 #pragma GCC optimize("O2")
 
 #include <cstdint>
+#include <cstdio>
 
 class PD1990 {
    public:
@@ -33,6 +34,7 @@ class PD1990 {
 
     uint8_t read(void);
     void write(int address, uint8_t value);
+    void snapshot(FILE *fp, bool save);
 
    private:
     uint8_t mCmd;
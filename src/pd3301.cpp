@@ -21,6 +21,7 @@
 */
 
 #include "pc88vm.h"
+#include "snapshot.h"
 
 #ifdef DEBUG_PC88
 // #define DEBUG_PD3301
@@ -40,6 +41,7 @@ PD3301::~PD3301() {}
 
 int PD3301::init(uint8_t *vrtc) {
     mVRTC = vrtc;
+    mVRAM = 0;
 
     // DisplayController.
     fabgl::BitmappedDisplayController::queueSize = 128;
@@ -63,6 +65,11 @@ int PD3301::init(uint8_t *vrtc) {
         *(mVramCache + i) = WHITE;
     }
 
+    mTextFont = (uint8_t *)heap_caps_malloc(80 * 200, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    mTextColor = (uint8_t *)heap_caps_malloc(80 * 25, MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    mTextRebuild = TEXT_ROWS_ALL;
+    mBlink = false;
+
     mColor[BLACK] = RGB_COLOR222(0, 0, 0);
     mColor[BLUE] = RGB_COLOR222(0, 0, 3);
     mColor[RED] = RGB_COLOR222(3, 0, 0);
@@ -81,6 +88,7 @@ int PD3301::init(uint8_t *vrtc) {
     }
 
     mColorPalette16 = (uint16_t *)heap_caps_malloc(8 * 8 * sizeof(uint16_t), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
+    mColorPalette32 = (uint32_t *)heap_caps_malloc(64 * 64 * sizeof(uint32_t), MALLOC_CAP_32BIT | MALLOC_CAP_INTERNAL);
 
     mFont64 = (uint64_t *)heap_caps_malloc(256 * 8, MALLOC_CAP_32BIT | MALLOC_CAP_INTERNAL);
     auto p = mFont64;
@@ -153,7 +161,11 @@ void PD3301::reset() {
     mCharRows = 16;
 
     mPCG = false;
-    mUpdateVRAM = false;
+    invalidateVRAM();
+    invalidateText();
+    for (int i = 0; i < 25; i++) {
+        mRowAttr[i] = WHITE;
+    }
 
     m200Line = true;
     mHighResolution = false;
@@ -164,11 +176,22 @@ void PD3301::reset() {
 
 void PD3301::end() { mDisplayController.end(); }
 
+// VRTC is driven by the emulated frame timing of PC88VM.
+void IRAM_ATTR PD3301::vrtc(bool value) {
+    if (value) {
+        *mVRTC |= 0x20;
+    } else {
+        *mVRTC &= 0xdf;
+        mFrameCounter++;
+    }
+}
+
 void PD3301::setVRAM(int vram) {
 #ifdef DEBUG_PD3301
     Serial.printf("VRAM %04x\n", vram);
 #endif
     mVRAM = vram;
+    invalidateVRAM();
 }
 
 int PD3301::getVRAM(void) { return mVRAM; }
@@ -179,6 +202,7 @@ void PD3301::setDMA(bool status) {
     Serial.printf("DMA start %s\n", status ? "true" : "false");
 #endif
     mDisplay = mDMAStart && mTextOn;
+    if (mDisplay) invalidateText();
 }
 
 // dispdrivers/vgadirectcontroller.cpp L287
@@ -205,12 +229,14 @@ void PD3301::initColorPalette16() {
     for (int color = 0; color < 8; color++) {
         setColorPalette16(color);
     }
+    updateColorPalette32();
 }
 
 void PD3301::setColorPalette(int color, int palette) {
     if (mHColor) {
         mColorPalette[color] = mColor[palette];
         setColorPalette16(color);
+        updateColorPalette32();
     }
     mColorPaletteSave[color] = mColor[palette];
 }
@@ -224,6 +250,14 @@ void PD3301::setColorPalette16(int color) {
     }
 }
 
+void PD3301::updateColorPalette32(void) {
+    for (int i = 0; i < 64; i++) {
+        for (int j = 0; j < 64; j++) {
+            *(mColorPalette32 + (i << 6) + j) = (uint32_t)mColorPalette16[i] << 16 | mColorPalette16[j];
+        }
+    }
+}
+
 void PD3301::displayMode(uint8_t value, bool highResolution) {
     bool hColor = value & 0x10;
 
@@ -264,7 +298,10 @@ void PD3301::crtcCmd(uint8_t value) {
 
     if ((value & 0xfe) == CRTC_OCW5) {  // OCw5: Load cursor position
         mCRTCCmd = CRTC_OCW5;
-        mCursorDisplay = value & 0x01;
+        if (mCursorDisplay != (value & 0x01)) {
+            mCursorDisplay = value & 0x01;
+            invalidateTextRow(mCursorY);
+        }
     } else if (value == CRTC_OCW1_ICW) {
         mCRTCCmd = CRTC_OCW1_ICW;  // ICW (OCW1): Stop display
         mTextOn = false;
@@ -274,6 +311,7 @@ void PD3301::crtcCmd(uint8_t value) {
         mReverse = value & 0x01;
         mTextOn = true;
         mDisplay = mDMAStart && mTextOn;
+        invalidateText();
 #ifdef DEBUG_PD3301
         Serial.println("OCW2: Start display");
 #endif
@@ -296,14 +334,17 @@ void PD3301::crtcData(uint8_t value) {
         mLine25 = (mCRTCData[1] & 0x3f) == 0x18;
         mCharRows = mLine25 ? 16 : 20;
         mColorMode = (mCRTCData[4] & 0x40);
+        invalidateVRAM();
+        invalidateText();
         mCRTCCmd = 0;
         mCRTCDataCount = 0;
     } else if ((mCRTCCmd & 0xfe) == CRTC_OCW5 && (mCRTCDataCount == 2)) {
-        bool disp = false;
-        if (mCursorX != mCRTCData[0]) disp = true;
-        if (mCursorY != mCRTCData[1]) disp = true;
-        mCursorX = mCRTCData[0];
-        mCursorY = mCRTCData[1];
+        if (mCursorX != mCRTCData[0] || mCursorY != mCRTCData[1]) {
+            invalidateTextRow(mCursorY);
+            mCursorX = mCRTCData[0];
+            mCursorY = mCRTCData[1];
+            invalidateTextRow(mCursorY);
+        }
         mCRTCCmd = 0;
         mCRTCDataCount = 0;
     }
@@ -338,8 +379,11 @@ void PD3301::setGvramMask(void) {
 }
 
 void PD3301::setCloumn80(bool value) {
+    if (mColumn80 == value) return;
     mColumn80 = value;
     mCursorMask = value ? 0xff : 0xfe;
+    invalidateVRAM();
+    invalidateText();
 }
 
 void PD3301::setPCG(bool value) {
@@ -347,6 +391,7 @@ void PD3301::setPCG(bool value) {
     Serial.printf("PD3301:PCG %s\n", value ? "on" : "off");
 #endif
     mPCG = value;
+    invalidateText();
 }
 
 void PD3301::suspend(bool value) {
@@ -359,98 +404,118 @@ void PD3301::suspend(bool value) {
 #ifdef DEBUG_PD3301
         Serial.println("mDisplayController.run()");
 #endif
+        invalidateText();
         run();
     }
 }
 
+// CRTC and display state, the caches are rebuilt from it
+void PD3301::snapshot(FILE *fp, bool save) {
+    SNAPSHOT_IO(fp, save, mCRTCCmd);
+    SNAPSHOT_IO(fp, save, mCRTCData);
+    SNAPSHOT_IO(fp, save, mCRTCDataCount);
+    SNAPSHOT_IO(fp, save, mDisplay);
+    SNAPSHOT_IO(fp, save, mTextOn);
+    SNAPSHOT_IO(fp, save, mDMAStart);
+    SNAPSHOT_IO(fp, save, mCursorDisplay);
+    SNAPSHOT_IO(fp, save, mHColor);
+    SNAPSHOT_IO(fp, save, mFrameCounter);
+    SNAPSHOT_IO(fp, save, mTEXTEnable);
+    SNAPSHOT_IO(fp, save, mPort52);
+    SNAPSHOT_IO(fp, save, mPort53);
+    SNAPSHOT_IO(fp, save, mVRAM);
+    SNAPSHOT_IO(fp, save, mCursorX);
+    SNAPSHOT_IO(fp, save, mCursorY);
+    SNAPSHOT_IO(fp, save, mColorPalette);
+    SNAPSHOT_IO(fp, save, mColorPaletteSave);
+    SNAPSHOT_IO(fp, save, mColorMode);
+    SNAPSHOT_IO(fp, save, mColumn80);
+    SNAPSHOT_IO(fp, save, mCursorMask);
+    SNAPSHOT_IO(fp, save, mLine25);
+    SNAPSHOT_IO(fp, save, mCharRows);
+    SNAPSHOT_IO(fp, save, mPCG);
+    SNAPSHOT_IO(fp, save, m200Line);
+    SNAPSHOT_IO(fp, save, mHighResolution);
+    SNAPSHOT_IO(fp, save, mReverse);
+    SNAPSHOT_IO(fp, save, mGvramMask);
+
+    if (save) return;
+
+    initColorPalette16();
+    invalidateVRAM();
+    invalidateText();
+}
+
 uint8_t PD3301::RGB_COLOR222(uint8_t r, uint8_t g, uint8_t b) { return ((b & 0x3) << 4) | ((g & 0x03) << 2) | (r & 0x03); }
 
 #define SCREEN_BORDER 40
 #define SCREEN_WIDTH 640
+#define SCREEN_HEIGHT 480
 
 void IRAM_ATTR PD3301::drawScanline(void *arg, uint8_t *dest, int scanLine) {
     auto pd3301 = (PD3301 *)arg;
 
+    if (scanLine == 0) {
+        pd3301->startFrame();
+    }
+
     auto boarderColor = pd3301->mDisplayController.createRawPixel(RGB222(0, 0, 0));
     auto hvsync = pd3301->mDisplayController.createBlankRawPixel();
-    uint64_t hvsyncs64;
-    memset(&hvsyncs64, hvsync, 8);
-    auto color = pd3301->mColor;
-    auto fontPtr = pd3301->mFontPtr;
-    auto vramCache = pd3301->mVramCache;
-    auto charRows = pd3301->mCharRows;
-    auto gVramMask = pd3301->mGvramMask;
-    auto color64 = pd3301->mColor64;
-    auto font64 = pd3301->mFont64;
-    auto colorPalette16 = pd3301->mColorPalette16;
 
-    if (scanLine == 0) {
-        pd3301->mFrameCounter++;
-        *pd3301->mVRTC &= 0xdf;
+    pd3301->render(dest, scanLine, SCANLINES_PER_CALLBACK, boarderColor, hvsync);
+}
+
+// Rows to rebuild are latched once per frame
+void IRAM_ATTR PD3301::startFrame(void) {
+    mTextRebuild = mTextDirty.exchange(0);
+    bool blink = (mFrameCounter & 0x3f) < 0x0f;
+    if (mBlink != blink) {
+        mBlink = blink;
+        mTextRebuild = TEXT_ROWS_ALL;
     }
+}
 
-    if (pd3301->m200Line) {  // 200 Lines
-        if (pd3301->mDisplay) {
-            auto cursorMask = pd3301->mCursorMask;
-            for (int line = scanLine; line < scanLine + SCANLINES_PER_CALLBACK; line += 2) {
+// Compose the lines [scanLine, scanLine + lines) of the 640x480 screen into dest, two lines at a time.
+// Pixels are in the byte order of the VGA DMA buffer, a pixel x is at the byte x ^ 2.
+void IRAM_ATTR PD3301::render(uint8_t *dest, int scanLine, int lines, uint8_t boarderColor, uint8_t hvsync) {
+    uint64_t hvsyncs64;
+    memset(&hvsyncs64, hvsync, 8);
+    auto color = mColor;
+    auto charRows = mCharRows;
+    auto gVramMask = mGvramMask;
+    auto color64 = mColor64;
+    auto font64 = mFont64;
+    auto colorPalette32 = mColorPalette32;
+
+    if (m200Line) {  // 200 Lines
+        if (mDisplay) {
+            for (int line = scanLine; line < scanLine + lines; line += 2) {
                 if (line < SCREEN_BORDER || line >= 400 + SCREEN_BORDER) {
                     memset(dest, boarderColor, SCREEN_WIDTH);
                     memset(dest + SCREEN_WIDTH, boarderColor, SCREEN_WIDTH);
                 } else {
                     uint64_t pixels64;
                     uint8_t font;
-                    union_8_32_t gColor;
-                    uint32_t attr;
+                    uint32_t gColor;
                     int y = line - SCREEN_BORDER;
 
-                    uint32_t *gvram = (uint32_t *)(pd3301->mGvramCache200 + (y >> 1) * 320);
+                    uint32_t *gvram = (uint32_t *)(mGvramCache200 + (y >> 1) * 320);
 
-                    auto row = (y % charRows) >> 1;
-                    auto upper = row == 0;
-                    y /= charRows;
-                    auto under = row == ((charRows >> 1) - 1);
-
-                    bool blink = (pd3301->mFrameCounter & 0x3f) < 0x0f;
-                    bool cursorOn = (pd3301->mCursorDisplay && (pd3301->mCursorY == y)) && blink;
-
-                    auto cursorX = pd3301->mCursorX;
-
-                    y *= 80;
+                    if (mTextRebuild & (1 << (y / charRows))) {
+                        composeTextLine(y);
+                    }
+                    auto textFont = mTextFont + (y >> 1) * 80;
+                    auto textColor = mTextColor + (y / charRows) * 80;
 
                     for (int x = 0; x < SCREEN_WIDTH / 8; x++) {
-                        attr = vramCache[x + y];
-                        font = fontPtr[(attr >> 16) * 10 + row];
-                        if (attr & ATTR_SECRET) {
-                            font = 0;
-                        }
-                        if (attr & ATTR_REVERSE) {
-                            font = ~font;
-                        }
-                        if ((attr & ATTR_BLINK) && blink) {
-                            attr &= 0xf0;
-                        }
-                        if ((attr & ATTR_UPPERLINE) && upper) {
-                            font = 0xff;
-                        }
-                        if ((attr & ATTR_UNDERLINE) && under) {
-                            font = 0xff;
-                        }
-                        font ^= (cursorOn && (x & cursorMask) == cursorX) ? 0xff : 0;
-                        if (pd3301->mReverse) {
-                            font = ~font;
-                        }
+                        font = textFont[x];
 
-                        gColor.uint32 = *gvram & gVramMask;
+                        gColor = *gvram & gVramMask;
 
-                        pixels64 = (uint64_t)colorPalette16[gColor.u.byte2];
-                        pixels64 <<= 16;
-                        pixels64 |= (uint64_t)colorPalette16[gColor.u.byte3];
-                        pixels64 <<= 16;
-                        pixels64 |= (uint64_t)colorPalette16[gColor.u.byte0];
-                        pixels64 <<= 16;
-                        pixels64 |= (uint64_t)colorPalette16[gColor.u.byte1];
+                        pixels64 = (uint64_t)colorPalette32[(gColor >> 10 & 0xfc0) | gColor >> 24] << 32;
+                        pixels64 |= colorPalette32[(gColor << 6 & 0xfc0) | (gColor >> 8 & 0x3f)];
 
-                        pixels64 = (color64[attr & 0x07] & font64[font]) | (pixels64 & ~font64[font]) | hvsyncs64;
+                        pixels64 = (color64[textColor[x]] & font64[font]) | (pixels64 & ~font64[font]) | hvsyncs64;
 
                         *((uint64_t *)(dest) + x) = pixels64;
                         *((uint64_t *)(dest) + x + SCREEN_WIDTH / 8) = pixels64;
@@ -461,27 +526,21 @@ void IRAM_ATTR PD3301::drawScanline(void *arg, uint8_t *dest, int scanLine) {
                 dest += SCREEN_WIDTH * 2;
             }
         } else {  // 200Lines DMA off
-            auto blackColor = pd3301->mDisplayController.createRawPixel(RGB222(0, 0, 0));
-            for (int line = scanLine; line < scanLine + SCANLINES_PER_CALLBACK; line += 2) {
+            for (int line = scanLine; line < scanLine + lines; line += 2) {
                 if (line < SCREEN_BORDER || line >= 400 + SCREEN_BORDER) {
                     memset(dest, boarderColor, SCREEN_WIDTH);
                     memset(dest + SCREEN_WIDTH, boarderColor, SCREEN_WIDTH);
                 } else {
                     int y = line - SCREEN_BORDER;
                     uint64_t pixels64;
-                    union_8_32_t gColor;
-                    uint32_t *gvram = (uint32_t *)(pd3301->mGvramCache200 + (y / 2) * 320);
+                    uint32_t gColor;
+                    uint32_t *gvram = (uint32_t *)(mGvramCache200 + (y / 2) * 320);
 
                     for (int x = 0; x < SCREEN_WIDTH / 8; x++) {
-                        gColor.uint32 = *gvram & gVramMask;
+                        gColor = *gvram & gVramMask;
 
-                        pixels64 = (uint64_t)colorPalette16[gColor.u.byte2];
-                        pixels64 <<= 16;
-                        pixels64 |= (uint64_t)colorPalette16[gColor.u.byte3];
-                        pixels64 <<= 16;
-                        pixels64 |= (uint64_t)colorPalette16[gColor.u.byte0];
-                        pixels64 <<= 16;
-                        pixels64 |= (uint64_t)colorPalette16[gColor.u.byte1];
+                        pixels64 = (uint64_t)colorPalette32[(gColor >> 10 & 0xfc0) | gColor >> 24] << 32;
+                        pixels64 |= colorPalette32[(gColor << 6 & 0xfc0) | (gColor >> 8 & 0x3f)];
 
                         pixels64 |= hvsyncs64;
 
@@ -495,58 +554,27 @@ void IRAM_ATTR PD3301::drawScanline(void *arg, uint8_t *dest, int scanLine) {
             }
         }
     } else {  // 400 Lines
-        if (pd3301->mDisplay) {
-            auto cursorMask = pd3301->mCursorMask;
-            for (int line = scanLine; line < scanLine + SCANLINES_PER_CALLBACK; line += 2) {
+        if (mDisplay) {
+            for (int line = scanLine; line < scanLine + lines; line += 2) {
                 if (line < SCREEN_BORDER || line >= 400 + SCREEN_BORDER) {
                     memset(dest, boarderColor, SCREEN_WIDTH);
                     memset(dest + SCREEN_WIDTH, boarderColor, SCREEN_WIDTH);
                 } else {
                     uint8_t font;
-                    uint32_t attr;
                     uint64_t textColor64;
                     int y = line - SCREEN_BORDER;
 
-                    auto gVramCache = pd3301->mGvramCache400 + y * 80;
-
-                    auto row = (y % charRows) >> 1;
-                    auto upper = row == 0;
-                    y /= charRows;
-                    auto under = row == ((charRows >> 1) - 1);
+                    auto gVramCache = mGvramCache400 + y * 80;
 
-                    bool blink = (pd3301->mFrameCounter & 0x3f) < 0x0f;
-                    bool cursorOn = (pd3301->mCursorDisplay && (pd3301->mCursorY == y)) && blink;
-
-                    auto cursorX = pd3301->mCursorX;
-
-                    y *= 80;
+                    if (mTextRebuild & (1 << (y / charRows))) {
+                        composeTextLine(y);
+                    }
+                    auto textFont = mTextFont + (y >> 1) * 80;
+                    auto textColor = mTextColor + (y / charRows) * 80;
 
                     for (int x = 0; x < SCREEN_WIDTH / 8; x++) {
-                        attr = vramCache[x + y];
-                        font = fontPtr[(attr >> 16) * 10 + row];
-                        if (attr & ATTR_SECRET) {
-                            font = 0;
-                        }
-                        if (attr & ATTR_REVERSE) {
-                            font = ~font;
-                        }
-                        if ((attr & ATTR_BLINK) && blink) {
-                            attr &= 0xf0;
-                        }
-                        if ((attr & ATTR_UPPERLINE) && upper) {
-                            font = 0xff;
-                        }
-                        if ((attr & ATTR_UNDERLINE) && under) {
-                            font = 0xff;
-                        }
-
-                        font ^= (cursorOn && (x & cursorMask) == cursorX) ? 0xff : 0;
-
-                        if (pd3301->mReverse) {
-                            font = ~font;
-                        }
-
-                        textColor64 = color64[attr & 0x07];
+                        font = textFont[x];
+                        textColor64 = color64[textColor[x]];
 
                         *((uint64_t *)(dest) + x) = (textColor64 & font64[font | *(gVramCache + x)]) | hvsyncs64;
                         *((uint64_t *)(dest) + x + SCREEN_WIDTH / 8) = (textColor64 & font64[font | *(gVramCache + x + 80)]) | hvsyncs64;
@@ -559,13 +587,13 @@ void IRAM_ATTR PD3301::drawScanline(void *arg, uint8_t *dest, int scanLine) {
             pixels = color[WHITE] << 8 | color[WHITE];
             pixels = pixels << 16 | pixels;
             pixels = pixels << 32 | pixels;
-            for (int line = scanLine; line < scanLine + SCANLINES_PER_CALLBACK; line += 2) {
+            for (int line = scanLine; line < scanLine + lines; line += 2) {
                 if (line < SCREEN_BORDER || line >= 400 + SCREEN_BORDER) {
                     memset(dest, boarderColor, SCREEN_WIDTH);
                     memset(dest + SCREEN_WIDTH, boarderColor, SCREEN_WIDTH);
                 } else {
                     int y = line - SCREEN_BORDER;
-                    auto gVramCache = pd3301->mGvramCache400 + y * 80;
+                    auto gVramCache = mGvramCache400 + y * 80;
 
                     for (int x = 0; x < SCREEN_WIDTH / 8; x++) {
                         *((uint64_t *)(dest) + x) = (pixels & font64[*(gVramCache + x)]) | hvsyncs64;
@@ -576,22 +604,113 @@ void IRAM_ATTR PD3301::drawScanline(void *arg, uint8_t *dest, int scanLine) {
             }
         }
     }
+}
+
+// Render a whole frame into a memory buffer of SCREEN_WIDTH * SCREEN_HEIGHT bytes, without sync bits
+void PD3301::renderFrame(uint8_t *dest) {
+    startFrame();
+    mTextRebuild = TEXT_ROWS_ALL;
+    render(dest, 0, SCREEN_HEIGHT, RGB_COLOR222(0, 0, 0), 0);
+}
+
+// Write the 640x400 display area of the current frame as a binary PPM (P6)
+int PD3301::dumpFrame(const char *fileName) {
+    auto frame = (uint8_t *)ps_malloc(SCREEN_WIDTH * SCREEN_HEIGHT);
+    if (frame == nullptr) return -1;
+
+    renderFrame(frame);
+
+    auto fp = fopen(fileName, "wb");
+    if (!fp) {
+        free(frame);
+        return -2;
+    }
 
-    if (scanLine >= 480 - SCANLINES_PER_CALLBACK) {
-        *pd3301->mVRTC |= 0x20;
-        pd3301->mUpdateVRAM = true;
+    fprintf(fp, "P6\n%d %d\n255\n", SCREEN_WIDTH, 400);
+
+    uint8_t rgb[SCREEN_WIDTH * 3];
+    for (int y = SCREEN_BORDER; y < 400 + SCREEN_BORDER; y++) {
+        auto line = frame + y * SCREEN_WIDTH;
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            auto pixel = line[x ^ 2];
+            rgb[x * 3] = (pixel & 0x03) * 85;
+            rgb[x * 3 + 1] = ((pixel >> 2) & 0x03) * 85;
+            rgb[x * 3 + 2] = ((pixel >> 4) & 0x03) * 85;
+        }
+        fwrite(rgb, 1, sizeof(rgb), fp);
     }
+
+    fclose(fp);
+    free(frame);
+
+    return 0;
 }
 
+// Font pattern and color of the text line y (0 - 398), from the decoded VRAM cache
+void IRAM_ATTR PD3301::composeTextLine(int y) {
+    auto fontPtr = mFontPtr;
+    auto charRows = mCharRows;
+    auto cursorMask = mCursorMask;
+    auto cursorX = mCursorX;
+    auto blink = mBlink;
+    auto reverse = mReverse;
+
+    auto textFont = mTextFont + (y >> 1) * 80;
+
+    auto row = (y % charRows) >> 1;
+    auto upper = row == 0;
+    y /= charRows;
+    auto under = row == ((charRows >> 1) - 1);
+
+    bool cursorOn = (mCursorDisplay && (mCursorY == y)) && blink;
+
+    auto vramCache = mVramCache + y * 80;
+    auto textColor = mTextColor + y * 80;
+
+    for (int x = 0; x < SCREEN_WIDTH / 8; x++) {
+        uint32_t attr = vramCache[x];
+        uint8_t font = fontPtr[(attr >> 16) * 10 + row];
+        if (attr & ATTR_SECRET) {
+            font = 0;
+        }
+        if (attr & ATTR_REVERSE) {
+            font = ~font;
+        }
+        if ((attr & ATTR_BLINK) && blink) {
+            attr &= 0xf0;
+        }
+        if ((attr & ATTR_UPPERLINE) && upper) {
+            font = 0xff;
+        }
+        if ((attr & ATTR_UNDERLINE) && under) {
+            font = 0xff;
+        }
+        font ^= (cursorOn && (x & cursorMask) == cursorX) ? 0xff : 0;
+        if (reverse) {
+            font = ~font;
+        }
+
+        textFont[x] = font;
+        textColor[x] = attr & 0x07;
+    }
+}
+
+// Called once per frame. Only the rows written since the last frame are decoded.
 bool IRAM_ATTR PD3301::updateVRAMcahce(void) {
-    if (!mDisplay || !mUpdateVRAM) return mDisplay;
+    if (!mDisplay || !mDirtyRows) return mDisplay;
 
-    mUpdateVRAM = false;
+    uint32_t dirty = mDirtyRows;
+    mDirtyRows = 0;
 
     uint16_t prevAttr = WHITE;
 
     if (mColumn80) {
         for (int row = 0; row < 25; row++) {
+            if (!(dirty & (1 << row))) {
+                prevAttr = mRowAttr[row];
+                continue;
+            }
+
             auto attrMode = false;
             auto attrPtr = mRAM + mVRAM + 120 * row + 80;
             memset(mVramCol, 0x80, 20);
@@ -704,9 +823,20 @@ bool IRAM_ATTR PD3301::updateVRAMcahce(void) {
                     prevAttr = attr;
                 }
             }
+
+            // the next row starts with the last attribute of this row
+            if (mRowAttr[row] != prevAttr) {
+                mRowAttr[row] = prevAttr;
+                dirty |= 1 << (row + 1);
+            }
         }
     } else {  // 40 columns
         for (int row = 0; row < 25; row++) {
+            if (!(dirty & (1 << row))) {
+                prevAttr = mRowAttr[row];
+                continue;
+            }
+
             auto attrMode = false;
             auto attrPtr = mRAM + mVRAM + 120 * row + 80;
             memset(mVramCol, 0x80, 20);
@@ -826,8 +956,16 @@ bool IRAM_ATTR PD3301::updateVRAMcahce(void) {
                     prevAttr = attr;
                 }
             }
+
+            // the next row starts with the last attribute of this row
+            if (mRowAttr[row] != prevAttr) {
+                mRowAttr[row] = prevAttr;
+                dirty |= 1 << (row + 1);
+            }
         }
     }
 
+    mTextDirty.fetch_or(dirty & TEXT_ROWS_ALL);
+
     return mDisplay;
 }
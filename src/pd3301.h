@@ -24,6 +24,8 @@
 
 #pragma GCC optimize("O2")
 
+#include <atomic>
+
 class PC88VM;
 
 #define BLACK 0
@@ -49,15 +51,8 @@ class PC88VM;
 #define GBANK_MAIN 3
 #define GBANK_UNUSED 4
 
-union union_8_32_t {
-    uint32_t uint32;
-    struct {
-        uint8_t byte0;
-        uint8_t byte1;
-        uint8_t byte2;
-        uint8_t byte3;
-    } u;
-};
+#define TEXT_VRAM_SIZE (120 * 25)
+#define TEXT_ROWS_ALL ((1 << 25) - 1)
 
 class PD3301 {
    public:
@@ -72,6 +67,7 @@ class PD3301 {
     void setVRAM(int vram);
     void setDMA(bool status);
     void end(void);
+    void vrtc(bool value);
     void run(void);
     bool VSync(void);
     void setColorPalette(int color, int palette);
@@ -90,9 +86,17 @@ class PD3301 {
     void suspend(bool value);
 
     bool updateVRAMcahce(void);
+    void textWrite(int offset) { mDirtyRows |= 1 << (offset / 120); }
+    void invalidateVRAM(void) { mDirtyRows = TEXT_ROWS_ALL; }
+    void invalidateText(void) { mTextDirty.fetch_or(TEXT_ROWS_ALL); }
 
     void initColorPalette();
 
+    void snapshot(FILE *fp, bool save);
+
+    void renderFrame(uint8_t *dest);
+    int dumpFrame(const char *fileName);
+
     fabgl::VGADirectController *getDisplayController(void) { return &mDisplayController; }
 
    private:
@@ -131,6 +135,7 @@ class PD3301 {
     uint8_t mColorPaletteSave[8];
 
     uint16_t *mColorPalette16;
+    uint32_t *mColorPalette32;  // 4 pixels of a pair of GVRAM cache bytes
 
     bool mColorMode;
     bool mColumn80;
@@ -145,7 +150,15 @@ class PD3301 {
     uint8_t *mVRTC;
 
     bool mPCG;
-    volatile bool mUpdateVRAM;
+    uint32_t mDirtyRows;     // 25 rows
+    uint16_t mRowAttr[25];  // attribute at the end of the row
+
+    // Text layer of each line (font pattern) and row (color), rebuilt only for dirty rows
+    uint8_t *mTextFont;                 // 80*200
+    uint8_t *mTextColor;                // 80*25
+    std::atomic<uint32_t> mTextDirty;  // set by the CPU side
+    uint32_t mTextRebuild;              // rows rebuilt in the current frame
+    bool mBlink;
 
     bool m200Line;
     bool mHighResolution;
@@ -159,8 +172,15 @@ class PD3301 {
     fabgl::VGADirectController mDisplayController;
 
     static void drawScanline(void *arg, uint8_t *dest, int scanLine);
+    void startFrame(void);
+    void render(uint8_t *dest, int scanLine, int lines, uint8_t boarderColor, uint8_t hvsync);
+    void composeTextLine(int y);
+    void invalidateTextRow(int row) {
+        if (row < 25) mTextDirty.fetch_or(1 << row);
+    }
     uint8_t RGB_COLOR222(uint8_t r, uint8_t g, uint8_t b);
     void setGvramMask(void);
     void initColorPalette16();
     void setColorPalette16(int color);
+    void updateColorPalette32(void);
 };
\ No newline at end of file
@@ -24,6 +24,8 @@
 
 #include <Arduino.h>
 
+#include "snapshot.h"
+
 #ifdef DEBUG_PC88
 // #define DEBUG_PD765C
 #endif
@@ -36,8 +38,10 @@ PD765C::PD765C() {
     mResultCount = 0;
 
     mBuffer = (uint8_t *)ps_malloc(256 * 32);
+    mData = mBuffer;
+    mInPlace = false;
 
-    for (int i; i < MAX_DRIVE; i++) {
+    for (int i = 0; i < MAX_DRIVE; i++) {
         mDrive[i].motor = false;
         mDrive[i].hasResult = false;
         mDrive[i].result = 0;
@@ -46,6 +50,14 @@ PD765C::PD765C() {
     }
 
     mIRQFlag = nullptr;
+
+    mTaskHandle = nullptr;
+    mIOQueue = nullptr;
+    mTrackPending = false;
+    mTrackLoaded = false;
+    mTrackError = false;
+    mWakeUp = nullptr;
+    mWakeUpContext = nullptr;
 }
 PD765C::~PD765C() {}
 
@@ -86,6 +98,8 @@ uint8_t PD765C::readStatusRegister(void) {  // Port FA
 }
 
 void PD765C::writeDataRegister(uint8_t value) {  // Port FB
+    if (mTrackPending) return;
+
     if (mPhase == WAITING_PHASE) {
         mPhase = COMMAND_PHASE;
     }
@@ -135,6 +149,11 @@ void PD765C::commandPhase(uint8_t value) {
     mCmd[mCmdCount] = value;
     mCmdCount++;
     mExecCmd = mCmd[0] & 0x1f;
+    execute();
+}
+
+// A command runs when its last byte is written, and again when it is resumed after its track is loaded
+void PD765C::execute(void) {
     switch (mExecCmd) {
         case READ_DIAGNOSTIC:
             readDiagnostic();
@@ -168,12 +187,90 @@ void PD765C::commandPhase(uint8_t value) {
             break;
         default:
 #ifdef DEBUG_PD765C
-            Serial.printf("PD765C Write data register %02x\n", value);
+            Serial.printf("PD765C Write data register %02x\n", mCmd[mCmdCount - 1]);
 #endif
             break;
     }
 }
 
+// Queue the track of the command unless it is in memory, true when the command has to wait for it
+// or has ended as its track could not be loaded
+bool PD765C::loadTrack(int us, int hd) {
+    if (mTrackLoaded) {
+        mTrackLoaded = false;
+        if (mTrackError) {
+            trackError(us, hd);
+            return true;
+        }
+        return false;
+    }
+
+    fdc_io_request_t request = {mDrive[us].disk, mDrive[us].cylinder * 2 + hd};
+    if (mIOQueue == nullptr || !request.disk->isReady() || request.disk->isTrackLoaded(request.trackNo)) return false;
+
+    // a full queue is waited for, a track is only read by the I/O task
+    if (xQueueSend(mIOQueue, &request, portMAX_DELAY) != pdTRUE) return false;
+
+#ifdef DEBUG_PD765C
+    Serial.printf("PD765C load track: US:%d track:%d\n", us, request.trackNo);
+#endif
+    mTrackPending = true;
+    mMainStatus = SR_CB;
+    return true;
+}
+
+// The command ends with not ready and no data as without a disk, the track is not read by the sub CPU instead
+void PD765C::trackError(int us, int hd) {
+    mResult[0] = ((hd << 2) | us) | ST0_AT | ST0_NR;  // ST0
+    mResult[1] = ST1_ND | ST1_MA;
+    mResult[2] = ST2_MD;
+    if (mExecCmd == READ_ID || mExecCmd == WRITE_ID) {
+        mResult[3] = mDrive[us].cylinder;
+        mResult[4] = hd;
+        mResult[5] = 1;
+        mResult[6] = mExecCmd == WRITE_ID ? mCmd[2] : 0;
+    } else {
+        memcpy(&mResult[3], &mCmd[2], 4);  // C, H, R, N
+    }
+    mResultCount = 7;
+    mResultOffset = 0;
+
+    mExecCmd = -1;
+    mPhase = RESULT_PHASE;
+    mMainStatus = SR_RQM | SR_DIO | SR_CB;
+    rasieIRQ();
+}
+
+void PD765C::resume(void) {
+    mTrackPending = false;
+    execute();
+}
+
+// Finish a command waiting for its track, the sub CPU must be stopped
+void PD765C::complete(void) {
+    if (!mTrackPending) return;
+    while (!mTrackLoaded) delay(1);
+    resume();
+}
+
+// Reset with the sub CPU. A track being loaded is waited for, so its completion does not resume a command after the reset
+void PD765C::reset(void) {
+    while (mTrackPending && !mTrackLoaded) delay(1);
+    mTrackPending = false;
+    mTrackLoaded = false;
+    mTrackError = false;
+
+    mMainStatus = SR_RQM;
+    mPhase = WAITING_PHASE;
+    mCmdCount = 0;
+    mResultCount = 0;
+}
+
+void PD765C::setWakeUp(void (*wakeUp)(void *), void *context) {
+    mWakeUpContext = context;
+    mWakeUp = wakeUp;
+}
+
 uint8_t PD765C::executionPhaseRead(void) {
     switch (mExecCmd) {
         case READ_DATA:
@@ -248,6 +345,8 @@ void PD765C::setIRQFlag(bool *irqFlag) { mIRQFlag = irqFlag; }
 
 void PD765C::readData(void) {
     if (mCmdCount > 8) {
+        if (loadTrack(mCmd[1] & 0x03, (mCmd[1] & 0x04) >> 2)) return;
+
 #ifdef DEBUG_PD765C
         Serial.printf("PD765C READ DATA - MT:%d MF:%d SK:%d HD:%d US:%d C:%02x H:%02x R:%02x N:%02x EOT:%02x GPL:%02x DTL:%02x\n",
                       (mCmd[0] & 0x80) >> 7, (mCmd[0] & 0x40) >> 6, (mCmd[0] & 0x20) >> 5, (mCmd[1] & 0x04) >> 2, mCmd[1] & 0x03, mCmd[2],
@@ -285,8 +384,9 @@ void PD765C::readData(void) {
 uint8_t PD765C::readDataExecution(void) {
     if (mBuffCount == 0 || mBuffOffset >= mBuffCount) {
         mIO.cylinder = mDrive[mIO.US].cylinder;
-        auto rc = mDrive[mIO.US].disk->readData(mBuffer, &mIO);
+        auto rc = mDrive[mIO.US].disk->getSector(&mIO, &mSector);
         if (rc > 0) {
+            mData = mSector.data;
             mBuffCount = rc;
             mBuffOffset = 0;
             mMainStatus = SR_NDM | SR_DIO | SR_CB;
@@ -304,7 +404,7 @@ uint8_t PD765C::readDataExecution(void) {
             return 0;
         }
     }
-    auto result = mBuffer[mBuffOffset];
+    auto result = mData[mBuffOffset];
     mBuffOffset++;
     rasieIRQ();
 
@@ -319,6 +419,8 @@ void PD765C::readDataResult(void) {
 
 void PD765C::readDiagnostic(void) {
     if (mCmdCount > 8) {
+        if (loadTrack(mCmd[1] & 0x03, (mCmd[1] & 0x04) >> 2)) return;
+
 #ifdef DEBUG_PD765C
         Serial.printf("PD765C Read diagnostic %02x %02x %02x %02x %02x %02x %02x %02x %02x\n", mCmd[0], mCmd[1], mCmd[2], mCmd[3], mCmd[4],
                       mCmd[5], mCmd[6], mCmd[7], mCmd[8]);
@@ -355,6 +457,7 @@ uint8_t PD765C::readDiagnosticExecution(void) {
     if (mBuffCount == 0 || mBuffOffset >= mBuffCount) {
         mIO.cylinder = mDrive[mIO.US].cylinder;
         auto rc = mDrive[mIO.US].disk->readDiagnostic(mBuffer, &mIO);
+        mData = mBuffer;
         if (rc > 0) {
             mBuffCount = rc;
             mBuffOffset = 0;
@@ -371,7 +474,7 @@ uint8_t PD765C::readDiagnosticExecution(void) {
             return 0;
         }
     }
-    auto result = mBuffer[mBuffOffset];
+    auto result = mData[mBuffOffset];
     mBuffOffset++;
     rasieIRQ();
 
@@ -386,6 +489,8 @@ void PD765C::readDiagnosticResult(void) {
 
 void PD765C::readId(void) {
     if (mCmdCount > 1) {
+        if (loadTrack(mCmd[1] & 0x03, (mCmd[1] & 0x04) >> 2)) return;
+
 #ifdef DEBUG_PD765C
         Serial.printf("PD765C Read ID MT:%d MF:%d SK:%d HD:%d US:%d\n", (mCmd[0] & 0x80) >> 7, (mCmd[0] & 0x40) >> 6, (mCmd[0] & 0x20) >> 5,
                       (mCmd[1] & 0x04) >> 2, mCmd[1] & 0x03);
@@ -438,6 +543,8 @@ void PD765C::readIdResult(void) {
 
 void PD765C::writeData(void) {
     if (mCmdCount > 8) {
+        if (loadTrack(mCmd[1] & 0x03, (mCmd[1] & 0x04) >> 2)) return;
+
 #ifdef DEBUG_PD765C
         Serial.printf("PD765C WRITE DATA - MT:%d MF:%d SK:%d HD:%d US:%d C:%02x H:%02x R:%02x N:%02x EOT:%02x GPL:%02x DTL:%02x\n",
                       (mCmd[0] & 0x80) >> 7, (mCmd[0] & 0x40) >> 6, (mCmd[0] & 0x20) >> 5, (mCmd[1] & 0x04) >> 2, mCmd[1] & 0x03, mCmd[2],
@@ -479,7 +586,14 @@ void PD765C::writeData(void) {
 }
 
 void PD765C::writeDataExecution(uint8_t value) {
-    mBuffer[mBuffOffset] = value;
+    if (mBuffOffset == 0) {
+        // a sector at least as long as the transfer is written in place, otherwise through mBuffer as before
+        mIO.cylinder = mDrive[mIO.US].cylinder;
+        auto rc = mDrive[mIO.US].disk->getSectorForWrite(&mIO, &mSector);
+        mInPlace = rc >= mBuffCount;
+        mData = mInPlace ? mSector.data : mBuffer;
+    }
+    mData[mBuffOffset] = value;
     mBuffOffset++;
     if (mBuffOffset < mBuffCount) {
         mMainStatus = SR_NDM | SR_CB;
@@ -487,8 +601,14 @@ void PD765C::writeDataExecution(uint8_t value) {
 #ifdef DEBUG_PD765C
         Serial.printf("writeDataExecution: write: %d\n", mIO.sectorLength);
 #endif
-        mIO.cylinder = mDrive[mIO.US].cylinder;
-        auto rc = mDrive[mIO.US].disk->writeData(mBuffer, &mIO);
+        int rc;
+        if (mInPlace) {
+            mDrive[mIO.US].disk->commitSector(&mSector);
+            rc = mSector.size;
+        } else {
+            mIO.cylinder = mDrive[mIO.US].cylinder;
+            rc = mDrive[mIO.US].disk->writeData(mBuffer, &mIO);
+        }
         mIO.R++;
         if (mIO.R > mIO.EOT) {
             mIO.C++;
@@ -540,6 +660,8 @@ void PD765C::writeDataResult(void) {
 
 void PD765C::writeId(void) {
     if (mCmdCount > 5) {
+        if (loadTrack(mCmd[1] & 0x03, (mCmd[1] & 0x04) >> 2)) return;
+
 #ifdef DEBUG_PD765C
         Serial.printf("PD765C Write ID %02x %02x %02x %02x %02x %02x\n", mCmd[0], mCmd[1], mCmd[2], mCmd[3], mCmd[4], mCmd[5]);
 #endif
@@ -696,12 +818,92 @@ void PD765C::senseDeviceStatus(void) {
     }
 }
 
-int PD765C::openDrive(int drive, char *fileName) { return mDrive[drive].disk->open(fileName); }
+int PD765C::openDrive(int drive, char *fileName, int image) {
+    releaseSector(drive);
+    return mDrive[drive].disk->open(fileName, image);
+}
 
-int PD765C::closeDrive(int drive) { return mDrive[drive].disk->close(); }
+int PD765C::closeDrive(int drive) {
+    releaseSector(drive);
+    return mDrive[drive].disk->close();
+}
 
 void PD765C::eject(void) {
     for (int i = 0; i < MAX_DRIVE; i++) {
+        releaseSector(i);
         mDrive[i].disk->close();
     }
 }
+
+// A transfer in the sector of an image to be closed goes on in mBuffer, a write then fails as the drive is not ready
+void PD765C::releaseSector(int drive) {
+    if (mData == mBuffer || mIO.US != drive) return;
+    memcpy(mBuffer, mData, mBuffCount < 256 * 32 ? mBuffCount : 256 * 32);
+    mData = mBuffer;
+    mInPlace = false;
+}
+
+void PD765C::run(void) {
+    mIOQueue = xQueueCreate(FDC_IO_QUEUE, sizeof(fdc_io_request_t));
+    xTaskCreateUniversal(&ioTask, "d88IOTask", 4096, this, 1, &mTaskHandle, APP_CPU_NUM);
+}
+
+void PD765C::flush(void) {
+    for (int i = 0; i < MAX_DRIVE; i++) {
+        mDrive[i].disk->flush();
+    }
+}
+
+// The file I/O of the disks: the tracks for the commands, and the write back every D88_FLUSH_INTERVAL ms
+void PD765C::ioTask(void *pvParameters) {
+    auto fdc = (PD765C *)pvParameters;
+    auto lastFlush = millis();
+    fdc_io_request_t request;
+
+    while (true) {
+        if (xQueueReceive(fdc->mIOQueue, &request, D88_FLUSH_INTERVAL / portTICK_PERIOD_MS) == pdTRUE) {
+            fdc->mTrackError = request.disk->loadTrack(request.trackNo) < 0;
+            fdc->mTrackLoaded = true;
+            if (fdc->mWakeUp) fdc->mWakeUp(fdc->mWakeUpContext);
+        }
+        if (millis() - lastFlush >= D88_FLUSH_INTERVAL) {
+            lastFlush = millis();
+            for (int i = 0; i < MAX_DRIVE; i++) {
+                fdc->mDrive[i].disk->flush(D88_FLUSH_DELAY);
+            }
+        }
+    }
+}
+
+// The disk images are not saved, a snapshot is restored with the same disks mounted
+void PD765C::snapshot(FILE *fp, bool save) {
+    SNAPSHOT_IO(fp, save, mMainStatus);
+    SNAPSHOT_IO(fp, save, mPhase);
+    SNAPSHOT_IO(fp, save, mCmdCount);
+    SNAPSHOT_IO(fp, save, mCmd);
+    SNAPSHOT_IO(fp, save, mUS);
+    SNAPSHOT_IO(fp, save, mIO);
+    SNAPSHOT_IO(fp, save, mWriteID);
+    SNAPSHOT_IO(fp, save, mResult);
+    SNAPSHOT_IO(fp, save, mResultCount);
+    SNAPSHOT_IO(fp, save, mResultOffset);
+    // a transfer in place continues through mBuffer after loading
+    if (save && mData != mBuffer) memcpy(mBuffer, mData, mBuffCount < 256 * 32 ? mBuffCount : 256 * 32);
+    SNAPSHOT_BLOCK(fp, save, mBuffer, 256 * 32);
+    SNAPSHOT_IO(fp, save, mBuffOffset);
+    SNAPSHOT_IO(fp, save, mBuffCount);
+    for (int i = 0; i < MAX_DRIVE; i++) {
+        SNAPSHOT_IO(fp, save, mDrive[i].motor);
+        SNAPSHOT_IO(fp, save, mDrive[i].hasResult);
+        SNAPSHOT_IO(fp, save, mDrive[i].result);
+        SNAPSHOT_IO(fp, save, mDrive[i].cylinder);
+    }
+    SNAPSHOT_IO(fp, save, mExecCmd);
+    SNAPSHOT_IO(fp, save, mWritePrecompensation);
+    SNAPSHOT_IO(fp, save, mVFO);
+
+    if (!save) {
+        mData = mBuffer;
+        mInPlace = false;
+    }
+}
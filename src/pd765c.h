@@ -100,6 +100,14 @@
 
 #define MAX_DRIVE (4)
 
+// Track loads queued to the disk I/O task
+#define FDC_IO_QUEUE (4)
+
+typedef struct {
+    PC88D88 *disk;
+    int trackNo;
+} fdc_io_request_t;
+
 typedef struct {
     bool motor;
     bool hasResult;
@@ -124,12 +132,43 @@ class PD765C {
 
     void setIRQFlag(bool *irqFlag);
 
-    int openDrive(int drive, char *fileName);
+    // A command waits for the I/O task to load its track, update() resumes it in the sub CPU loop
+    void setWakeUp(void (*wakeUp)(void *), void *context);
+    bool isWaiting(void) { return mTrackPending; }
+    void update(void) {
+        if (mTrackPending && mTrackLoaded) resume();
+    }
+    void complete(void);
+    void reset(void);
+
+    int openDrive(int drive, char *fileName, int image = 0);
     int closeDrive(int drive);
+    PC88D88 *getDisk(int drive) { return mDrive[drive].disk; }
 
     void eject(void);
 
+    // Load the tracks and write back the disks in the background, flush() writes them back now
+    void run(void);
+    void flush(void);
+
+    void snapshot(FILE *fp, bool save);
+
    private:
+    TaskHandle_t mTaskHandle;
+    QueueHandle_t mIOQueue;
+    static void ioTask(void *pvParameters);
+
+    // The command reports SR_CB without SR_RQM while its track is loaded, as a drive does while it rotates
+    volatile bool mTrackPending;
+    volatile bool mTrackLoaded;
+    volatile bool mTrackError;
+    void (*mWakeUp)(void *);
+    void *mWakeUpContext;
+    bool loadTrack(int us, int hd);
+    void releaseSector(int drive);
+    void resume(void);
+    void trackError(int us, int hd);
+
     uint8_t mMainStatus;
 
     int mPhase;
@@ -149,6 +188,11 @@ class PD765C {
     int mBuffOffset;
     int mBuffCount;
 
+    // Data of the current sector: the track buffer of the disk (mInPlace) or mBuffer
+    uint8_t *mData;
+    bool mInPlace;
+    d88_sector_view_t mSector;
+
     drive_status_t mDrive[MAX_DRIVE];
 
     int mExecCmd;
@@ -159,6 +203,7 @@ class PD765C {
     uint8_t mVFO;
 
     void commandPhase(uint8_t value);
+    void execute(void);
     uint8_t executionPhaseRead(void);
     void executionPhaseWrite(uint8_t value);
     void resultPhase(void);
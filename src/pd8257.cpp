@@ -21,6 +21,7 @@
 */
 
 #include "pc88vm.h"
+#include "snapshot.h"
 
 #ifdef DEBUG_PC88
 // #define DEBUG_PD8257
@@ -64,7 +65,7 @@ void PD8257::dmaAddress(int channel, uint8_t value) {
             Serial.printf("DMA Address %d %04x\n", channel, mChannelAddress[channel]);
 #endif
             if (channel == 2) {
-                mVM->getPD3301()->setVRAM(mChannelAddress[channel]);
+                mVM->setVRAM(mChannelAddress[channel]);
                 channel = 0;
             }
             break;
@@ -81,4 +82,10 @@ void PD8257::dmaCmd(uint8_t value)  // Port68
     mPort68 = value;
 }
 
-uint8_t PD8257::inPort68(void) { return mPort68; }
\ No newline at end of file
+uint8_t PD8257::inPort68(void) { return mPort68; }
+
+void PD8257::snapshot(FILE *fp, bool save) {
+    SNAPSHOT_IO(fp, save, mChannelAddress);
+    SNAPSHOT_IO(fp, save, mChannelCount);
+    SNAPSHOT_IO(fp, save, mPort68);
+}
@@ -34,6 +34,7 @@ class PD8257 {
     void dmaTerminalCount(int channel, uint8_t value);
     void dmaCmd(uint8_t value);
     uint8_t inPort68(void);
+    void snapshot(FILE *fp, bool save);
 
    private:
     PC88VM *mVM;
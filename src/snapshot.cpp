@@ -0,0 +1,141 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "snapshot.h"
+
+#ifdef DEBUG_PC88
+// #define DEBUG_SNAPSHOT
+#endif
+
+typedef struct {
+    int address;
+    const uint8_t *code;
+    int size;
+} snapshot_code_t;
+
+void SNAPSHOT::z80(FILE *fp, bool save, fabgl::Z80 *cpu) {
+    z80_regs_t regs;
+
+    if (save) {
+        getZ80(cpu, &regs);
+        fwrite(&regs, sizeof(regs), 1, fp);
+    } else if (fread(&regs, sizeof(regs), 1, fp) == 1) {
+        setZ80(cpu, &regs);
+    }
+}
+
+void SNAPSHOT::getZ80(fabgl::Z80 *cpu, z80_regs_t *regs) {
+    static const uint8_t ldAR[] = {0xed, 0x5f};            // LD A,R
+    static const uint8_t ldAI[] = {0xed, 0x57};            // LD A,I
+    static const uint8_t exchange[] = {0xd9, 0x08};        // EXX, EX AF,AF'
+    static const uint8_t halt[] = {0x76};                  // HALT
+
+    for (int i = 0; i < 7; i++) {
+        regs->word[i] = cpu->readRegWord(i);
+    }
+    regs->pc = cpu->getPC();
+    regs->iff1 = cpu->getIFF1();
+    regs->iff2 = cpu->getIFF2();
+    regs->im = cpu->getIM();
+    regs->halt = cpu->getStatus() == fabgl::Z80_STATUS_HALT;
+
+    // R is incremented by the two opcode fetches of LD A,R
+    exec(cpu, 0, ldAR, sizeof(ldAR));
+    auto r = cpu->readRegByte(fabgl::Z80_A);
+    regs->r = (r & 0x80) | ((r - 2) & 0x7f);
+
+    exec(cpu, 0, ldAI, sizeof(ldAI));
+    regs->i = cpu->readRegByte(fabgl::Z80_A);
+
+    exec(cpu, 0, exchange, sizeof(exchange));
+    for (int i = 0; i < 4; i++) {
+        regs->alternates[i] = cpu->readRegWord(i);
+    }
+    exec(cpu, 0, exchange, sizeof(exchange));
+
+    // put R, AF and PC back, HALT fetches one more opcode
+    uint8_t liveR = regs->halt ? (regs->r & 0x80) | ((regs->r - 1) & 0x7f) : regs->r;
+    uint8_t ldRA[] = {0x3e, liveR, 0xed, 0x4f};  // LD A,n; LD R,A
+    exec(cpu, 0, ldRA, sizeof(ldRA));
+    cpu->writeRegWord(fabgl::Z80_AF, regs->word[fabgl::Z80_AF]);
+    if (regs->halt) {
+        exec(cpu, (regs->pc - 1) & 0xffff, halt, sizeof(halt));
+    }
+    cpu->setPC(regs->pc);
+}
+
+// IFF2 is restored as IFF1, they only differ in an NMI handler
+void SNAPSHOT::setZ80(fabgl::Z80 *cpu, z80_regs_t *regs) {
+    static const uint8_t exchange[] = {0xd9, 0x08};  // EXX, EX AF,AF'
+    static const uint8_t im[3] = {0x46, 0x56, 0x5e};  // IM 0, IM 1, IM 2
+    static const uint8_t halt[] = {0x76};            // HALT
+
+    for (int i = 0; i < 4; i++) {
+        cpu->writeRegWord(i, regs->alternates[i]);
+    }
+    exec(cpu, 0, exchange, sizeof(exchange));
+
+    // HALT fetches one more opcode
+    uint8_t r = regs->halt ? (regs->r & 0x80) | ((regs->r - 1) & 0x7f) : regs->r;
+    uint8_t code[] = {
+        0x3e, regs->i, 0xed, 0x47,            // LD A,n; LD I,A
+        0xed, im[regs->im < 3 ? regs->im : 0],  // IM n
+        (uint8_t)(regs->iff1 ? 0xfb : 0xf3),    // EI or DI
+        0x3e, r, 0xed, 0x4f,                    // LD A,n; LD R,A
+    };
+    exec(cpu, 0, code, sizeof(code));
+
+    for (int i = 0; i < 7; i++) {
+        cpu->writeRegWord(i, regs->word[i]);
+    }
+    if (regs->halt) {
+        exec(cpu, (regs->pc - 1) & 0xffff, halt, sizeof(halt));
+    }
+    cpu->setPC(regs->pc);
+}
+
+// Run the code placed at the address until the PC leaves it
+void SNAPSHOT::exec(fabgl::Z80 *cpu, int address, const uint8_t *code, int size) {
+    snapshot_code_t context = {address, code, size};
+
+    cpu->setCallbacks(&context, readByte, writeByte, readWord, writeWord, readIO, writeIO);
+    cpu->setPC(address);
+    for (int i = 0; i < size && ((cpu->getPC() - address) & 0xffff) < size; i++) {
+        cpu->step();
+    }
+}
+
+int SNAPSHOT::readByte(void *context, int address) {
+    auto code = (snapshot_code_t *)context;
+    auto offset = (address - code->address) & 0xffff;
+    return offset < code->size ? code->code[offset] : 0;
+}
+
+void SNAPSHOT::writeByte(void *context, int address, int value) {}
+
+int SNAPSHOT::readWord(void *context, int addr) { return readByte(context, addr) | (readByte(context, addr + 1) << 8); }
+
+void SNAPSHOT::writeWord(void *context, int addr, int value) {}
+
+int SNAPSHOT::readIO(void *context, int address) { return 0xff; }
+
+void SNAPSHOT::writeIO(void *context, int address, int value) {}
@@ -0,0 +1,70 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <cstdint>
+#include <cstdio>
+
+#include "emudevs/Z80.h"
+
+// Snapshot file: SNAPSHOT_ID, version, machine configuration, then the state of each device in a fixed order
+#define SNAPSHOT_ID "PC88SNAP"
+#define SNAPSHOT_VERSION (1)
+
+// Write (save = true) or read a field or a memory block of the state, errors are checked once with ferror()/feof()
+#define SNAPSHOT_IO(fp, save, value) ((save) ? fwrite(&(value), sizeof(value), 1, fp) : fread(&(value), sizeof(value), 1, fp))
+#define SNAPSHOT_BLOCK(fp, save, ptr, size) ((save) ? fwrite(ptr, 1, size, fp) : fread(ptr, 1, size, fp))
+
+typedef struct {
+    uint16_t word[7];        // BC, DE, HL, AF, IX, IY, SP
+    uint16_t alternates[4];  // BC', DE', HL', AF'
+    uint16_t pc;
+    uint8_t i;
+    uint8_t r;
+    uint8_t iff1;
+    uint8_t iff2;
+    uint8_t im;
+    uint8_t halt;
+} z80_regs_t;
+
+class SNAPSHOT {
+   public:
+    // Z80 registers. The registers without accessors in fabgl::Z80 (alternates, I, R, IM, IFF, HALT)
+    // are read and written by short instruction sequences, so the memory and I/O callbacks of the CPU
+    // are replaced. The caller sets its callbacks again.
+    static void z80(FILE *fp, bool save, fabgl::Z80 *cpu);
+    static void getZ80(fabgl::Z80 *cpu, z80_regs_t *regs);
+    static void setZ80(fabgl::Z80 *cpu, z80_regs_t *regs);
+
+   private:
+    static void exec(fabgl::Z80 *cpu, int address, const uint8_t *code, int size);
+
+    static int readByte(void *context, int address);
+    static void writeByte(void *context, int address, int value);
+    static int readWord(void *context, int addr);
+    static void writeWord(void *context, int addr, int value);
+    static int readIO(void *context, int address);
+    static void writeIO(void *context, int address, int value);
+};
@@ -0,0 +1,228 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "sound-mixer.h"
+
+#include <Arduino.h>
+
+#include <cstdlib>
+
+#include "pc88scheduler.h"
+
+#ifdef DEBUG_PC88
+// #define DEBUG_SOUND_MIXER
+#endif
+
+#define SOUND_EVENT_COUNTER 0
+#define SOUND_EVENT_ENABLE 1
+#define SOUND_EVENT_BEEP 2
+#define SOUND_EVENT_SING 3
+
+#define SOUND_MIXER_AMPLITUDE (40)               // of a source, 4 sources may overflow a little
+#define SOUND_MIXER_BEEP (SOUND_MIXER_COUNTERS)  // source number of the beeper
+#define SOUND_MIXER_BEEP_FREQ (2400)
+#define SOUND_MIXER_RESYNC (FRAME_CYCLES * 4)  // a longer gap is a reset or a snapshot
+
+SoundMixer::SoundMixer() {
+    mEvents = nullptr;
+    mSamples = nullptr;
+    mEventHead = 0;
+    mEventTail = 0;
+    mSampleHead = 0;
+    mSampleTail = 0;
+    mPlaying = false;
+    mLastSample = 0;
+    mSampleCycles = CPU_CLOCK / 16000;
+    reset(0);
+}
+
+SoundMixer::~SoundMixer() {
+    if (mEvents) free(mEvents);
+    if (mSamples) free(mSamples);
+}
+
+// Call after the mixer is attached to the sound generator
+int SoundMixer::init(void) {
+    mEvents = (sound_event_t *)malloc(sizeof(sound_event_t) * SOUND_MIXER_EVENTS);
+    mSamples = (int8_t *)malloc(SOUND_MIXER_SAMPLES);
+    if (mEvents == nullptr || mSamples == nullptr) return -1;
+
+    mSampleCycles = CPU_CLOCK / sampleRate();
+    enable(true);
+    return 0;
+}
+
+void SoundMixer::reset(uint32_t clock) {
+    mEventHead = 0;
+    mEventTail = 0;
+
+    for (int i = 0; i <= SOUND_MIXER_COUNTERS; i++) {
+        mPeriod[i] = 0;
+        mPhase[i] = 0;
+        mEnabled[i] = false;
+    }
+    mPeriod[SOUND_MIXER_BEEP] = CPU_CLOCK / SOUND_MIXER_BEEP_FREQ;
+    mSing = false;
+
+    mClock = clock;
+    mSampleStart = clock;
+    mLevel = 0;
+}
+
+void SoundMixer::setCounter(int counter, uint16_t value, uint32_t clock) { push(SOUND_EVENT_COUNTER, counter, value, clock); }
+
+void SoundMixer::enableCounter(int counter, bool value, uint32_t clock) { push(SOUND_EVENT_ENABLE, counter, value, clock); }
+
+void SoundMixer::beep(bool value, uint32_t clock) { push(SOUND_EVENT_BEEP, SOUND_MIXER_BEEP, value, clock); }
+
+void SoundMixer::sing(bool value, uint32_t clock) { push(SOUND_EVENT_SING, 0, value, clock); }
+
+void SoundMixer::push(uint8_t type, int counter, uint16_t value, uint32_t clock) {
+    if (mEvents == nullptr) return;
+
+    auto next = (mEventHead + 1) % SOUND_MIXER_EVENTS;
+    if (next == mEventTail) {
+        render(clock);
+    }
+
+    auto event = &mEvents[mEventHead];
+    event->clock = clock;
+    event->type = type;
+    event->counter = counter;
+    event->value = value;
+    mEventHead = (mEventHead + 1) % SOUND_MIXER_EVENTS;
+}
+
+void SoundMixer::apply(sound_event_t *event) {
+    switch (event->type) {
+        case SOUND_EVENT_COUNTER:
+            mPeriod[event->counter] = event->value;
+            if (event->value) {
+                mPhase[event->counter] %= event->value;
+            }
+            break;
+        case SOUND_EVENT_ENABLE:
+        case SOUND_EVENT_BEEP:
+            mEnabled[event->counter] = event->value;
+            break;
+        case SOUND_EVENT_SING:
+            mSing = event->value;
+            break;
+    }
+}
+
+void IRAM_ATTR SoundMixer::render(uint32_t clock) {
+    if (mSamples == nullptr) return;
+
+    if ((int32_t)(clock - mClock) < 0 || clock - mClock > SOUND_MIXER_RESYNC) {
+#ifdef DEBUG_SOUND_MIXER
+        Serial.printf("SoundMixer: resync %08x -> %08x\n", mClock, clock);
+#endif
+        while (mEventTail != mEventHead) {
+            apply(&mEvents[mEventTail]);
+            mEventTail = (mEventTail + 1) % SOUND_MIXER_EVENTS;
+        }
+        mClock = clock;
+        mSampleStart = clock;
+        mLevel = 0;
+    }
+
+    while (mEventTail != mEventHead) {
+        auto event = &mEvents[mEventTail];
+        if ((int32_t)(event->clock - clock) > 0) break;
+        renderTo(event->clock);
+        apply(event);
+        mEventTail = (mEventTail + 1) % SOUND_MIXER_EVENTS;
+    }
+    renderTo(clock);
+}
+
+// Sum of the level of a square wave source for cycles from its phase
+int32_t IRAM_ATTR SoundMixer::level(int source, uint32_t cycles) {
+    auto period = mPeriod[source];
+    if (period == 0) return 0;
+
+    auto phase = mPhase[source];
+    auto end = phase + cycles;
+    mPhase[source] = end % period;
+
+    // Above the sampling rate a source is only a DC level, as the 15kHz limit of the square wave generator
+    if (!mEnabled[source] || period < 2) return 0;
+
+    // High for the first half of the period (mode 3 of the 8253)
+    auto half = (period + 1) / 2;
+    auto high = (end / period) * half + (end % period < half ? end % period : half);
+    high -= phase < half ? phase : half;
+
+    return SOUND_MIXER_AMPLITUDE * (2 * (int32_t)high - (int32_t)cycles);
+}
+
+void IRAM_ATTR SoundMixer::renderTo(uint32_t clock) {
+    while ((int32_t)(clock - mClock) > 0) {
+        auto sampleEnd = mSampleStart + mSampleCycles;
+        auto end = (int32_t)(clock - sampleEnd) < 0 ? clock : sampleEnd;
+        auto cycles = end - mClock;
+
+        for (int i = 0; i <= SOUND_MIXER_COUNTERS; i++) {
+            mLevel += level(i, cycles);
+        }
+        if (mSing) {
+            mLevel += SOUND_MIXER_AMPLITUDE * (int32_t)cycles;
+        }
+        mClock = end;
+
+        if (end == sampleEnd) {
+            int sample = mLevel / mSampleCycles;
+            if (sample > 127) sample = 127;
+            if (sample < -128) sample = -128;
+
+            // Samples are dropped while the emulation runs faster than the sound
+            auto next = (mSampleHead + 1) & (SOUND_MIXER_SAMPLES - 1);
+            if (next != mSampleTail) {
+                mSamples[mSampleHead] = sample;
+                mSampleHead = next;
+            }
+            mLevel = 0;
+            mSampleStart = sampleEnd;
+        }
+    }
+}
+
+// Called by the sound task of FabGL
+int IRAM_ATTR SoundMixer::getSample(void) {
+    auto tail = mSampleTail;
+    auto count = (mSampleHead - tail) & (SOUND_MIXER_SAMPLES - 1);
+
+    // Wait for some frames after an underrun, the last sample is kept meanwhile
+    if (!mPlaying && count >= SOUND_MIXER_PREFILL) {
+        mPlaying = true;
+    }
+    if (mPlaying && count == 0) {
+        mPlaying = false;
+    }
+    if (mPlaying) {
+        mLastSample = mSamples[tail];
+        mSampleTail = (tail + 1) & (SOUND_MIXER_SAMPLES - 1);
+    }
+
+    return mLastSample * volume() / 127;
+}
@@ -0,0 +1,92 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <cstdint>
+
+#include "fabgl.h"
+
+#define SOUND_MIXER_COUNTERS (3)
+#define SOUND_MIXER_EVENTS (512)     // sound events of a frame
+#define SOUND_MIXER_SAMPLES (2048)   // power of 2
+#define SOUND_MIXER_PREFILL (640)    // samples buffered before the playback starts
+
+// Sound of the 8253 counters and the beeper, rendered from port writes stamped with the emulated clock.
+// The emulation task queues the writes and renders them once a frame, the sound task of FabGL
+// plays the rendered samples through getSample().
+class SoundMixer : public fabgl::WaveformGenerator {
+   public:
+    SoundMixer();
+    ~SoundMixer();
+
+    int init(void);
+    void reset(uint32_t clock);
+
+    // Port writes, clock is the emulated time in T-states
+    void setCounter(int counter, uint16_t value, uint32_t clock);
+    void enableCounter(int counter, bool value, uint32_t clock);
+    void beep(bool value, uint32_t clock);
+    void sing(bool value, uint32_t clock);
+
+    // Render the queued writes and the sound until clock
+    void render(uint32_t clock);
+
+    void setFrequency(int) {}
+    int getSample(void);
+
+   private:
+    typedef struct {
+        uint32_t clock;
+        uint8_t type;
+        uint8_t counter;
+        uint16_t value;
+    } sound_event_t;
+
+    sound_event_t *mEvents;
+    int mEventHead;
+    int mEventTail;
+
+    // Current state of the sources
+    uint32_t mPeriod[SOUND_MIXER_COUNTERS + 1];  // the beeper is the last one
+    uint32_t mPhase[SOUND_MIXER_COUNTERS + 1];
+    bool mEnabled[SOUND_MIXER_COUNTERS + 1];
+    bool mSing;
+
+    uint32_t mClock;        // rendered until
+    uint32_t mSampleStart;  // clock of the sample being rendered
+    int mSampleCycles;
+    int32_t mLevel;  // sum of the level of the sample being rendered
+
+    int8_t *mSamples;
+    volatile int mSampleHead;
+    volatile int mSampleTail;
+    volatile bool mPlaying;
+    int mLastSample;
+
+    void push(uint8_t type, int counter, uint16_t value, uint32_t clock);
+    void apply(sound_event_t *event);
+    void renderTo(uint32_t clock);
+    int32_t level(int source, uint32_t cycles);
+};
@@ -0,0 +1,281 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "tape-decoder.h"
+
+#include <cstring>
+
+#ifdef DEBUG_PC88
+// #define DEBUG_TAPE_DECODER
+#endif
+
+TapeDecoder *TapeDecoder::create(TapeStream *stream) {
+    char header[T88_ID_LENGTH];
+    int count = 0;
+
+    stream->rewind();
+    while (count < T88_ID_LENGTH) {
+        auto value = stream->read();
+        if (value < 0) break;
+        header[count++] = value;
+    }
+    stream->rewind();
+
+    if (count == T88_ID_LENGTH && !memcmp(header, T88_ID, strlen(T88_ID))) {
+#ifdef DEBUG_TAPE_DECODER
+        Serial.println("TapeDecoder: T88");
+#endif
+        return new T88Decoder(stream);
+    }
+    if (count >= 12 && !memcmp(header, "RIFF", 4) && !memcmp(header + 8, "WAVE", 4)) {
+        auto decoder = new WavDecoder(stream);
+        if (decoder->init() == 0) return decoder;
+        delete decoder;
+        stream->rewind();
+    }
+    return new TapeDecoder(stream);
+}
+
+// Little endian, -1 at the end of the tape
+int TapeDecoder::readWord(void) {
+    auto low = mStream->read();
+    auto high = mStream->read();
+    if (low < 0 || high < 0) return -1;
+    return low | (high << 8);
+}
+
+long TapeDecoder::readLong(void) {
+    auto low = readWord();
+    auto high = readWord();
+    if (low < 0 || high < 0) return -1;
+    return low | ((long)high << 16);
+}
+
+// T88
+
+int T88Decoder::read(bool) {
+    if (mRemain == 0 && !nextData()) return -1;
+
+    auto value = mStream->read();
+    if (value < 0) {
+        mEnd = true;
+        return -1;
+    }
+    mRemain--;
+    mPosition++;
+    return value;
+}
+
+// Skip to the data of the next data tag
+bool T88Decoder::nextData(void) {
+    while (!mEnd) {
+        auto id = readWord();
+        auto length = readWord();
+        if (id < 0 || length < 0 || id == T88_TAG_END) break;
+
+        if (id == T88_TAG_DATA && length >= 8) {
+            // start time, length of time, size and type of the data before the data, some files omit the length of time
+            uint8_t header[12];
+            int count = length >= 12 ? 12 : 8;
+            for (int i = 0; i < count; i++) header[i] = mStream->read();
+            if (count == 12 && 12 + (header[8] | (header[9] << 8)) == length) {
+                mRemain = length - 12;
+            } else if (8 + (header[4] | (header[5] << 8)) == length) {
+                mStream->skip(8 - count);
+                mRemain = length - 8;
+            } else {
+                mStream->skip(length - count);
+                continue;
+            }
+            if (mRemain > 0) return true;
+            continue;
+        }
+        mStream->skip(length);
+    }
+    mEnd = true;
+    return false;
+}
+
+// position < 0: the end of the tape
+void T88Decoder::seek(long position) {
+    mStream->seek(T88_ID_LENGTH);
+    mPosition = 0;
+    mRemain = 0;
+    mEnd = false;
+
+    while (position < 0 || mPosition < position) {
+        if (mRemain == 0 && !nextData()) break;
+        auto count = position < 0 || mRemain < position - mPosition ? mRemain : position - mPosition;
+        mStream->skip(count);
+        mRemain -= count;
+        mPosition += count;
+    }
+}
+
+// WAV
+
+int WavDecoder::init(void) {
+    mDataStart = 0;
+    mDataEnd = 0;
+    mSampleRate = 0;
+
+    mStream->seek(12);
+    while (true) {
+        char id[4];
+        for (int i = 0; i < 4; i++) {
+            auto value = mStream->read();
+            if (value < 0) return -1;
+            id[i] = value;
+        }
+        auto size = readLong();
+        if (size < 0) return -1;
+
+        if (!memcmp(id, "fmt ", 4) && size >= 16) {
+            auto format = readWord();
+            auto channels = readWord();
+            mSampleRate = readLong();
+            readLong();  // bytes per second
+            readWord();  // block align
+            auto bits = readWord();
+            if (format != 1 || channels < 1 || mSampleRate <= 0 || (bits != 8 && bits != 16)) return -1;
+            mSampleSize = bits / 8;
+            mFrameSize = mSampleSize * channels;
+            mStream->skip(size - 16 + (size & 1));
+        } else if (!memcmp(id, "data", 4)) {
+            if (mSampleRate == 0) return -1;
+            mDataStart = mStream->tell();
+            mDataEnd = mDataStart + size;
+
+            // a streamed or truncated file has a larger size than its data
+            mStream->seekEnd();
+            if (mStream->tell() < mDataEnd) mDataEnd = mStream->tell();
+            break;
+        } else {
+            mStream->skip(size + (size & 1));
+        }
+    }
+
+#ifdef DEBUG_TAPE_DECODER
+    Serial.printf("TapeDecoder: WAV %dHz frame %d data %ld\n", mSampleRate, mFrameSize, mDataEnd - mDataStart);
+#endif
+    seek(0);
+    return 0;
+}
+
+void WavDecoder::seek(long position) {
+    if (position < 0) position = 0;
+    if (position > mDataEnd - mDataStart) position = mDataEnd - mDataStart;
+    mStream->seek(mDataStart + position - position % mFrameSize);
+
+    mLevel = 0;
+    mHalfLength = 0;
+    mHalfClass = -1;
+    mHalfCount = 0;
+    mBitCount = -1;
+    mShift = 0;
+}
+
+// The first channel as a 16 bit sample
+bool WavDecoder::readSample(int *sample) {
+    if (mStream->tell() + mFrameSize > mDataEnd) return false;
+
+    int value;
+    if (mSampleSize == 1) {
+        value = mStream->read();
+        if (value < 0) return false;
+        value = (value - 0x80) << 8;
+    } else {
+        value = readWord();
+        if (value < 0) return false;
+        value = (int16_t)value;
+    }
+    if (mFrameSize > mSampleSize) mStream->skip(mFrameSize - mSampleSize);
+
+    *sample = value;
+    return true;
+}
+
+// Samples between two zero crossings, -1 at the end of the data
+int WavDecoder::nextHalf(void) {
+    int sample;
+    while (readSample(&sample)) {
+        mHalfLength++;
+        if ((sample > WAV_HYSTERESIS && mLevel <= 0) || (sample < -WAV_HYSTERESIS && mLevel >= 0)) {
+            auto first = mLevel == 0;
+            mLevel = sample > 0 ? 1 : -1;
+            auto length = mHalfLength;
+            mHalfLength = 0;
+            if (!first) return length;
+        }
+    }
+    return -1;
+}
+
+// A bit after its half cycles of 1200Hz (0) or 2400Hz (1), -1 at the end of the data
+int WavDecoder::nextBit(bool highBps) {
+    while (true) {
+        auto length = nextHalf();
+        if (length < 0) return -1;
+
+        if (length * WAV_FREQ_MAX < mSampleRate) continue;
+        if (length * WAV_FREQ_MIN > mSampleRate) {
+            mHalfClass = -1;
+            mHalfCount = 0;
+            continue;
+        }
+
+        auto bit = length * WAV_FREQ_THRESHOLD < mSampleRate ? 1 : 0;
+        if (bit != mHalfClass) {
+            mHalfClass = bit;
+            mHalfCount = 0;
+        }
+        mHalfCount++;
+        if (mHalfCount >= (highBps ? 2 : 4) << bit) {
+            mHalfCount = 0;
+            return bit;
+        }
+    }
+}
+
+int WavDecoder::read(bool highBps) {
+    while (true) {
+        auto bit = nextBit(highBps);
+        if (bit < 0) return -1;
+
+        if (mBitCount < 0) {
+            // waiting for a start bit
+            if (bit == 0) {
+                mBitCount = 0;
+                mShift = 0;
+            }
+        } else if (mBitCount < 8) {
+            mShift |= bit << mBitCount;
+            mBitCount++;
+        } else {
+            mBitCount = -1;
+            if (bit == 1) return mShift;
+#ifdef DEBUG_TAPE_DECODER
+            Serial.printf("TapeDecoder: framing error at %ld\n", tell());
+#endif
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#include <cstdint>
+
+#include "tape-stream.h"
+
+// T88: the header, then tags of an ID, a length and the data, the bytes of the CMT are in the data tags
+#define T88_ID "PC-8801 Tape Image(T88)"
+#define T88_ID_LENGTH (24)
+#define T88_TAG_END (0x0000)
+#define T88_TAG_DATA (0x0101)
+
+// WAV: the CMT records a 0 as 1200Hz and a 1 as 2400Hz, a bit is 2 cycles of 1200Hz at 600bps and 1 cycle at 1200bps.
+// A byte is a start bit (0), 8 data bits from the LSB and the stop bits (1).
+#define WAV_FREQ_THRESHOLD (3600)  // between a half cycle of 1200Hz and of 2400Hz
+#define WAV_FREQ_MIN (600)         // longer half cycles are silence
+#define WAV_FREQ_MAX (9600)        // shorter half cycles are noise
+#define WAV_HYSTERESIS (1024)      // of a 16 bit sample
+
+// The bytes of a tape file, read through the tape stream block by block.
+// A cmt file is the bytes themselves, T88 and WAV files are decoded and read-only.
+class TapeDecoder {
+   public:
+    TapeDecoder(TapeStream *stream) { mStream = stream; }
+    virtual ~TapeDecoder() {}
+
+    // The decoder of the format of the tape, a file of no known format is a cmt file
+    static TapeDecoder *create(TapeStream *stream);
+
+    // The next byte or -1 at the end of the tape, highBps: 1200bps, otherwise 600bps
+    virtual int read(bool) { return mStream->read(); }
+    virtual bool isWritable(void) { return true; }
+
+    // A cmt file holds the bytes of the data only, without the leader of the tape
+    virtual bool isRaw(void) { return true; }
+
+    // Position on the tape, restored by seek() for a snapshot
+    virtual long tell(void) { return mStream->tell(); }
+    virtual void seek(long position) { mStream->seek(position); }
+    virtual void seekEnd(void) { mStream->seekEnd(); }
+    void rewind(void) { seek(0); }
+
+   protected:
+    TapeStream *mStream;
+
+    int readWord(void);
+    long readLong(void);
+};
+
+class T88Decoder : public TapeDecoder {
+   public:
+    T88Decoder(TapeStream *stream) : TapeDecoder(stream) { seek(0); }
+
+    int read(bool highBps);
+    bool isWritable(void) { return false; }
+    bool isRaw(void) { return false; }
+
+    // The bytes read from the data tags
+    long tell(void) { return mPosition; }
+    void seek(long position);
+    void seekEnd(void) { seek(-1); }
+
+   private:
+    long mPosition;
+    long mRemain;  // bytes left in the current data tag
+    bool mEnd;
+
+    bool nextData(void);
+};
+
+class WavDecoder : public TapeDecoder {
+   public:
+    WavDecoder(TapeStream *stream) : TapeDecoder(stream) {}
+
+    int init(void);
+    int read(bool highBps);
+    bool isWritable(void) { return false; }
+    bool isRaw(void) { return false; }
+
+    // Offset of the samples, the decoder waits for the next start bit after seek()
+    long tell(void) { return mStream->tell() - mDataStart; }
+    void seek(long position);
+    void seekEnd(void) { seek(mDataEnd - mDataStart); }
+
+   private:
+    long mDataStart;
+    long mDataEnd;
+    int mSampleRate;
+    int mFrameSize;
+    int mSampleSize;
+
+    int mLevel;
+    int mHalfLength;
+    int mHalfClass;
+    int mHalfCount;
+    int mBitCount;
+    uint8_t mShift;
+
+    bool readSample(int *sample);
+    int nextHalf(void);
+    int nextBit(bool highBps);
+};
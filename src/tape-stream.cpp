@@ -0,0 +1,159 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "tape-stream.h"
+
+#include <cstdlib>
+
+#ifdef DEBUG_PC88
+// #define DEBUG_TAPE_STREAM
+#endif
+
+TapeStream::TapeStream() {
+    mFP = nullptr;
+    mBuffer = nullptr;
+    mBase = 0;
+    mCount = 0;
+    mOffset = 0;
+    mDirtyStart = 0;
+    mDirtyEnd = 0;
+}
+
+TapeStream::~TapeStream() {
+    close();
+    if (mBuffer) free(mBuffer);
+}
+
+int TapeStream::open(const char *fileName) {
+    close();
+
+    if (mBuffer == nullptr) {
+        mBuffer = (uint8_t *)malloc(TAPE_STREAM_BUFFER);
+        if (mBuffer == nullptr) return -1;
+    }
+
+    mFP = fopen(fileName, "rb+");
+    if (!mFP) {
+#ifdef DEBUG_TAPE_STREAM
+        Serial.printf("TapeStream: open error %s\n", fileName);
+#endif
+        return -1;
+    }
+
+    mBase = 0;
+    mCount = 0;
+    mOffset = 0;
+    mDirtyStart = 0;
+    mDirtyEnd = 0;
+    return 0;
+}
+
+int TapeStream::close(void) {
+    if (!mFP) return 0;
+
+    auto ret = flush();
+    fclose(mFP);
+    mFP = nullptr;
+    return ret;
+}
+
+int TapeStream::read(void) {
+    if (!mFP) return -1;
+    if (mOffset >= mCount && fill() <= 0) return -1;
+    return mBuffer[mOffset++];
+}
+
+int TapeStream::write(uint8_t value) {
+    if (!mFP) return -1;
+
+    if (mOffset >= TAPE_STREAM_BUFFER) {
+        if (flush() < 0) return -1;
+        mBase += mOffset;
+        mCount = 0;
+        mOffset = 0;
+    }
+
+    if (mDirtyEnd == 0) {
+        mDirtyStart = mOffset;
+    } else if (mOffset < mDirtyStart) {
+        mDirtyStart = mOffset;
+    }
+    mBuffer[mOffset++] = value;
+    if (mOffset > mDirtyEnd) mDirtyEnd = mOffset;
+    if (mOffset > mCount) mCount = mOffset;
+    return 1;
+}
+
+int TapeStream::flush(void) {
+    if (!mFP || mDirtyEnd == 0) return 0;
+
+    size_t size = mDirtyEnd - mDirtyStart;
+    auto ok = fseek(mFP, mBase + mDirtyStart, SEEK_SET) == 0 && fwrite(mBuffer + mDirtyStart, 1, size, mFP) == size;
+    ok = fflush(mFP) == 0 && ok;
+    mDirtyStart = 0;
+    mDirtyEnd = 0;
+
+#ifdef DEBUG_TAPE_STREAM
+    Serial.printf("TapeStream: flush %08lx %04x %d\n", mBase, size, ok);
+#endif
+    return ok ? 0 : -1;
+}
+
+int TapeStream::seek(long offset) {
+    if (!mFP) return -1;
+
+    auto ret = flush();
+    mBase = offset < 0 ? 0 : offset;
+    mCount = 0;
+    mOffset = 0;
+    return ret;
+}
+
+// Within the buffer without reading the file again
+int TapeStream::skip(long count) {
+    if (!mFP) return -1;
+    if (mOffset + count >= 0 && mOffset + count <= mCount) {
+        mOffset += count;
+        return 0;
+    }
+    return seek(tell() + count);
+}
+
+void TapeStream::seekEnd(void) {
+    if (!mFP) return;
+
+    flush();
+    fseek(mFP, 0, SEEK_END);
+    seek(ftell(mFP));
+}
+
+// Read ahead from the current position, the written bytes are flushed before
+int TapeStream::fill(void) {
+    if (flush() < 0) return -1;
+
+    mBase += mOffset;
+    mOffset = 0;
+    mCount = 0;
+    if (fseek(mFP, mBase, SEEK_SET) != 0) return -1;
+    mCount = fread(mBuffer, 1, TAPE_STREAM_BUFFER, mFP);
+    return mCount;
+}
@@ -0,0 +1,68 @@
+/*
+    This file is part of PC8801FabGL.
+
+    https://github.com/Basara767676/PC8801FabGL
+
+    Copyright (C) 2022 Basara767676
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#pragma GCC optimize("O2")
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#include <cstdint>
+
+#define TAPE_STREAM_BUFFER (4096)
+
+// A tape file read ahead and written behind through one block of TAPE_STREAM_BUFFER bytes.
+// A write overwrites the tape at the current position as the tape recorder does.
+class TapeStream {
+   public:
+    TapeStream();
+    ~TapeStream();
+
+    int open(const char *fileName);
+    int close(void);
+    bool isOpen(void) { return mFP != nullptr; }
+
+    // The next byte, or -1 at the end of the tape
+    int read(void);
+    int write(uint8_t value);
+
+    // Write the written bytes to the file
+    int flush(void);
+
+    long tell(void) { return mBase + mOffset; }
+    int seek(long offset);
+    int skip(long count);
+    void rewind(void) { seek(0); }
+    void seekEnd(void);
+
+   private:
+    FILE *mFP;
+    uint8_t *mBuffer;
+    long mBase;   // file offset of mBuffer
+    int mCount;   // valid bytes in mBuffer
+    int mOffset;  // current position in mBuffer
+    int mDirtyStart;
+    int mDirtyEnd;
+
+    int fill(void);
+};